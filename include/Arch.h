@@ -0,0 +1,129 @@
+/** @file Arch.h
+ *  @brief Architecture description of the overlay tiles
+ *
+ *  The architecture defines which units a tile (Block) is made of, which
+ *  unit and which block every instruction is placed into, the channel width
+ *  and the pin map of the ComputeUnit. It is either loaded from a small
+ *  config file or from a VPR architecture XML file. The default Arch is the
+ *  classic tile:
+ *
+ *    channel_width 0                      # 0: measured from the routing
+ *    unit SB    switch_box      0 0
+ *    unit CBIn  connection_box  0 1
+ *    unit CBOut connection_box  1 0
+ *    unit CU    compute_unit    1 1
+ *    route switch       SB     0  0       # block = coordinates + (dx, dy)
+ *    route connect_to   CBIn   0 -1
+ *    route connect_from CBOut  1  0
+ *    route bind         CU    -1 -1
+ *    input  IN  4                         # pins are numbered in port order
+ *    output OUT 4                         # as VPR does
+ *
+ *  Port lines are optional, without them the pin numbers reported by VPR
+ *  are used as they are.
+ *
+ *  Every unit has to be the target of exactly one route line, of the
+ *  opcode its kind and frame section encode, since the frame has one
+ *  section per opcode.
+ *
+ *  @author  Mahyar Emami(mayyxeng)
+ */
+#ifndef __ARCH_H__
+#define __ARCH_H__
+
+#include "Config.h"
+#include <map>
+#include <string>
+#include <vector>
+
+/** @brief Kinds of units a tile can be composed of */
+enum unit_kind_t { _switch_box_, _connection_box_, _compute_unit_ };
+
+/** @brief A unit of the tile */
+struct UnitSlot {
+  std::string name;
+  unit_kind_t kind;
+  Coordinate_t local; // coordinates of the unit in the tile
+};
+
+/** @brief Placement of the instructions of one opcode */
+struct RouteRule {
+  int slot;            // index of the unit in the tile, -1 to drop
+  Coordinate_t offset; // block = instruction coordinates + offset
+};
+
+/** @brief A port of the ComputeUnit */
+struct PortInfo {
+  std::string name;
+  int num_pins;
+  int first_pin; // pin number of index 0 of the port
+  bool input;
+};
+
+class Arch {
+public:
+  /** @brief constructs the classic tile, see the file description */
+  Arch();
+
+  /** @brief Loads an architecture. Files ending in .xml are read as VPR
+   *  architecture files, anything else as an Arch config file.
+   *  @param path architecture file name
+   *  @param tile name of the tile in a VPR file, the first tile that is
+   *         not an io if empty
+   *  @return the loaded architecture
+   */
+  static Arch Load(const char *path, const std::string &tile = "");
+
+  /** @brief physical pin number of a pin of the ComputeUnit
+   *  @param port port name of the pin
+   *  @param index index of the pin in the port
+   *  @param vpr_pin pin number reported by VPR, used if there is no pin map
+   *  @return the pin number
+   */
+  int pinNumber(const std::string &port, int index, int vpr_pin) const;
+
+  /** @return number of pins of the ComputeUnit, 0 if there is no pin map */
+  int getNumPins() const { return num_pins; }
+  /** @return channel width, 0 if it is measured from the routing */
+  int getChannelWidth() const { return channel_width; }
+  void setChannelWidth(int width) { channel_width = width; }
+  const std::vector<UnitSlot> &getUnits() const { return units; }
+  /** @return placement rule of the instructions of opcode */
+  const RouteRule &getRule(Instructions::Opcode opcode) const {
+    return rules[opcode];
+  }
+  /** @return coordinates of the block the instruction is placed into */
+  Coordinate_t blockOf(const Instructions::Inst_t &inst) const {
+    return inst.getCoordinates() + getRule(inst.getOpcode()).offset;
+  }
+  /** @return index x + y * cols of the block of inst in an array of rows x
+   *  cols blocks starting at origin, -1 if x or y is outside of it
+   */
+  int blockIndex(const Instructions::Inst_t &inst, Coordinate_t origin,
+                 int rows, int cols) const {
+    auto block = blockOf(inst);
+    int x = block.at_x() - origin.at_x();
+    int y = block.at_y() - origin.at_y();
+    if (x < 0 || x >= cols || y < 0 || y >= rows)
+      return -1;
+    return x + y * cols;
+  }
+
+private:
+  void clear();
+  void addPort(const std::string &name, int num_pins, bool input);
+  int findUnit(const std::string &name) const;
+  void validate(const char *path) const;
+  void parseConfig(std::istream &in, const char *path);
+  void parseVPR(const std::string &text, const char *path,
+                const std::string &tile);
+
+  int channel_width;
+  int num_pins;
+  std::vector<UnitSlot> units;
+  RouteRule rules[Instructions::_null_ + 1];
+  std::vector<PortInfo> ports;
+  std::map<std::string, int> port_index;
+};
+
+#endif // __ARCH_H__
@@ -0,0 +1,228 @@
+/** @file Bitstream.h
+ *  @brief Frame-addressed bitstream image of an Overlay
+ *
+ *  Each block of the overlay is configured by one fixed-size frame so the
+ *  configuration of block (x, y) sits at a computable offset in the image:
+ *
+ *    offset(x, y, c) = header_size + frames * 8 +
+ *                      (x + (y + c * rows) * cols) * frame_words * 8
+ *
+ *  where c is the configuration context for multi-context overlays, all
+ *  frames of context 0 come first. The header is followed by a table of
+ *  one 64-bit FrameChecksum per frame, in the same order as the frames, so
+ *  an update finds the changed frames without reading the others.
+ *
+ *  A frame is a sequence of 64-bit words holding 16-bit fields, four fields
+ *  per word starting from the least significant bits. It has four sections,
+ *  each starting on a word boundary:
+ *
+ *    SB     4 * W fields, one per (side, track) output of the SwitchBox:
+ *           [valid:1][input side:2][input track:13]
+ *    CBIn   4 * P fields, one per (side, pin) of the ComputeUnits fed by
+ *           the tracks of the block: [valid:1][side of the track:2][track:13]
+ *    CBOut  4 * W fields, one per (side, track) around the ComputeUnit:
+ *           [valid:1][pin:15]
+ *    CU     2 * P fields, the 32 bit id of the component bound to each pin
+ *           (low half first), 0 when the pin is unbound
+ *
+ *  W is the channel width and P the number of pins of the tile. Sides use
+ *  Switch::TLoc, N S W E. Words are stored in the host byte order.
+ *
+ *  @author  Mahyar Emami(mayyxeng)
+ */
+#ifndef __BITSTREAM_H__
+#define __BITSTREAM_H__
+
+#include "Overlay.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/** @brief Sections of a block frame */
+enum frame_section_t { _sb_, _cb_in_, _cb_out_, _cu_ };
+
+/** @brief Sizes of the configuration frame of a block, known at run time */
+struct FrameLayout {
+  FrameLayout(int width = 0, int pins = 0)
+      : channel_width(width), num_pins(pins){};
+  /** @return number of 16-bit fields of section */
+  int fields(frame_section_t section) const;
+  /** @return word offset of section in the frame */
+  int offset(frame_section_t section) const;
+  /** @return number of 64-bit words in a frame */
+  int words() const;
+
+  int channel_width;
+  int num_pins;
+};
+
+/** @brief Frame layout of the common tiles, fixed at compile time so the
+ *  encoding kernels fold all offsets and bounds into constants.
+ */
+template <int W, int P> struct FixedLayout {
+  static constexpr int channel_width = W;
+  static constexpr int num_pins = P;
+  constexpr int offset(frame_section_t section) const {
+    return section == _sb_       ? 0
+           : section == _cb_in_  ? W
+           : section == _cb_out_ ? W + P
+                                 : 2 * W + P;
+  }
+  constexpr int words() const { return 2 * W + P + (P + 1) / 2; }
+};
+
+/** @brief View over the words of one block frame
+ *  @tparam Layout FrameLayout or one of the FixedLayout specializations
+ */
+template <class Layout> class FrameView {
+public:
+  FrameView(const Layout &layout, uint64_t *words)
+      : layout(layout), words(words){};
+  /** @brief sets a 16-bit field of a section
+   *  @param section section of the field
+   *  @param index index of the field in the section
+   *  @param value new value of the field
+   */
+  void set(frame_section_t section, int index, uint16_t value) {
+    uint64_t &word = words[layout.offset(section) + index / 4];
+    int shift = 16 * (index % 4);
+    word = (word & ~(0xFFFFull << shift)) | ((uint64_t)value << shift);
+  }
+  /** @return value of a 16-bit field of a section */
+  uint16_t get(frame_section_t section, int index) const {
+    uint64_t word = words[layout.offset(section) + index / 4];
+    return (word >> (16 * (index % 4))) & 0xFFFF;
+  }
+  /** @brief zeroes all the fields */
+  void clear() {
+    for (int i = 0; i < layout.words(); i++)
+      words[i] = 0;
+  }
+  const Layout &getLayout() const { return layout; }
+
+private:
+  const Layout &layout;
+  uint64_t *words;
+};
+
+typedef FrameView<FrameLayout> Frame;
+
+/** @brief Random access to the frames of a bitstream image */
+class BitstreamFile {
+public:
+  /** @brief Opens an existing image
+   *  @param path image file name
+   *  @param writable open for in-place updates
+   */
+  BitstreamFile(const char *path, bool writable);
+  /** @brief Creates an empty image of contexts x rows x cols zeroed
+   *  frames
+   */
+  BitstreamFile(const char *path, int rows, int cols,
+                const FrameLayout &layout, int contexts = 1);
+  ~BitstreamFile();
+
+  /** @return byte offset of the frame of block (x, y) in a context */
+  off_t frameOffset(int x, int y, int context = 0) const;
+  /** @brief reads the frame of block (x, y) of a context into words */
+  void readFrame(int x, int y, uint64_t *words, int context = 0) const;
+  /** @brief writes the frame of block (x, y) of a context from words */
+  void writeFrame(int x, int y, const uint64_t *words, int context = 0);
+  /** @brief maps all the frames into memory, must be called before
+   *  frameData. Writes through the mapping land in the file.
+   */
+  void mapFrames();
+  /** @return the mapped frame of block (x, y) of a context. Distinct frames
+   *  may be accessed from several threads.
+   */
+  uint64_t *frameData(int x, int y, int context = 0) {
+    return frames + (((size_t)context * rows + y) * cols + x) * layout.words();
+  }
+  /** @return the mapped checksum of the frame of block (x, y) of a
+   *  context, see FrameChecksum
+   */
+  uint64_t &frameChecksum(int x, int y, int context = 0) {
+    return checksums[((size_t)context * rows + y) * cols + x];
+  }
+
+  const FrameLayout &getLayout() const { return layout; }
+  int getRows() const { return rows; }
+  int getCols() const { return cols; }
+  int getContexts() const { return contexts; }
+
+private:
+  void checkBlock(int x, int y, int context) const;
+
+  std::string path;
+  int fd;
+  bool writable;
+  uint64_t *frames;    // mapped frames, null until mapFrames()
+  uint64_t *checksums; // mapped checksum table, null until mapFrames()
+  size_t map_size;
+  int rows;
+  int cols;
+  int contexts;
+  FrameLayout layout;
+};
+
+/** @return checksum of the count words of a frame, 0 only for a zero
+ *  frame so the table of a fresh image matches its frames
+ */
+uint64_t FrameChecksum(const uint64_t *words, int count);
+
+/** @brief Computes the frame layout of the overlay. Dimensions given by
+ *  the architecture are used as they are, the others are the smallest that
+ *  fit the configuration.
+ */
+FrameLayout MeasureLayout(Overlay &overlay);
+
+/** @brief grows measured to fit the fields of inst */
+void MeasureInstruction(FrameLayout &measured, Instructions::Inst_t *inst);
+
+/** @return the layout of arch, dimensions it leaves open are taken from
+ *  measured
+ */
+FrameLayout FitLayout(const Arch &arch, const FrameLayout &measured);
+
+/** @brief Bounds check for frame fields, the layout has to fit first */
+inline void CheckField(const char *what, int value, int limit) {
+  if (value < 0 || value >= limit) {
+    DPRINTF("\n\tError: %s %d does not fit in the frame (limit %d)\n", what,
+            value, limit);
+    exit(EXIT_FAILURE);
+  }
+}
+
+/** @brief Encodes the configuration of a context of block into a zeroed
+ *  frame
+ */
+typedef void (*BlockEncoder)(Block &block, int context,
+                             const FrameLayout &layout, uint64_t *words);
+
+/** @brief Picks the encoding kernel for a layout once per image. Common
+ *  layouts get a kernel specialized on FixedLayout, others the generic one.
+ */
+BlockEncoder SelectEncoder(const FrameLayout &layout);
+
+/** @brief Writes the full image of overlay to path. Tiles of blocks are
+ *  encoded in parallel, straight into their frames of the mapped image.
+ *  Contexts sharing a slot copy the frame of its first context and empty
+ *  blocks are skipped, their frames stay zero.
+ *  @param layout frame layout to use, measured from overlay if null.
+ *         Regions of one overlay share the layout of the whole overlay.
+ *  @param threads maximum number of threads, NumThreads() if 0
+ *  @return number of frames written
+ */
+int WriteBitstream(Overlay &overlay, const char *path,
+                   const FrameLayout *layout = nullptr, int threads = 0);
+
+/** @brief Updates an existing image in place to the configuration of
+ *  overlay. Every block is encoded, empty blocks to zero frames, and only
+ *  the frames whose checksum differs from the stored one are written back.
+ *  Unchanged frames are never read, only the checksum table is. Tiles are
+ *  encoded in parallel as in WriteBitstream.
+ *  @return number of frames written
+ */
+int UpdateBitstream(Overlay &overlay, const char *path);
+
+#endif // __BITSTREAM_H__
@@ -0,0 +1,70 @@
+/** @file ChannelStats.h
+ *  @brief Channel and track utilization of a routing
+ *
+ *  ChannelStats counts how often every track of every CHANX and CHANY
+ *  segment is used by the routing, in dense arrays indexed by
+ *  (x, y, track). RouteBuilder fills it while the nodes are decoded, every
+ *  parser thread owns one and they are merged once parsing is done.
+ *
+ *  @author  Mahyar Emami(mayyxeng)
+ */
+#ifndef __CHANNEL_STATS_H__
+#define __CHANNEL_STATS_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class ChannelStats {
+public:
+  /** @param width expected channel width, the counters grow with the
+   *  tracks seen
+   */
+  ChannelStats(int width = 0);
+  /** @brief sizes the counters for an array of rows x cols logic blocks,
+   *  channels run from 0 to cols + 1 and rows + 1. Counts are cleared.
+   */
+  void resize(int rows, int cols);
+  /** @brief counts a use of a track, uses outside of the array are only
+   *  counted as dropped
+   *  @param chanx 1 for CHANX, 0 for CHANY
+   */
+  void add(bool chanx, int x, int y, int track) {
+    if (x < 0 || x >= dim_x || y < 0 || y >= dim_y || track < 0) {
+      dropped++;
+      return;
+    }
+    if (track >= width)
+      widen(track + 1);
+    counts[chanx][(y * dim_x + x) * stride + track]++;
+  }
+  /** @brief adds the counts of other, both have to be sized for the same
+   *  array
+   */
+  void merge(const ChannelStats &other);
+
+  /** @return number of uses of a track */
+  uint32_t count(bool chanx, int x, int y, int track) const;
+  /** @return highest track used + 1 */
+  int getWidth() const { return width; }
+
+  /** @brief writes the used tracks as CSV, chan,x,y,track,count */
+  void writeHeatmap(const std::string &path) const;
+  /** @brief writes the uses and the used tracks summed over every row and
+   *  every column as CSV,
+   *  axis,index,chanx_uses,chany_uses,chanx_tracks,chany_tracks
+   */
+  void writeHistograms(const std::string &path) const;
+
+private:
+  void widen(int new_width);
+
+  int dim_x;
+  int dim_y;
+  int width;  // highest track used + 1
+  int stride; // allocated tracks per channel
+  std::vector<uint32_t> counts[2]; // CHANY, CHANX
+  uint64_t dropped;
+};
+
+#endif // __CHANNEL_STATS_H__
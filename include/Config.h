@@ -5,13 +5,16 @@
 #ifndef __CONFIG_H__
 #define __CONFIG_H__
 
+#include <memory>
 #include <regex>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
 #include <vector>
 
 #define MIN(a, b) a <= b ? a : b
+#define MAX(a, b) ((a) >= (b) ? (a) : (b))
 
 // Debuf printf helper macro
 #define DEBUG 1
@@ -62,26 +65,43 @@ namespace Instructions {
 enum Opcode { _switch_, _connect_to_, _connect_from_, _set_, _bind_, _null_ };
 class Inst_t {
 public:
-  Inst_t(){};
+  Inst_t(Opcode opcode = _null_) : opcode(opcode){};
+  virtual ~Inst_t(){};
 
   /** @brief a function that generates human readable instruction
    *  @return returns a string representing the instruction
    */
   virtual std::string getStr() { return std::string(""); };
-  /** @brief opcode getter for instructions
+  /** @brief opcode getter for instructions. The opcode is stored in the
+   *  instruction so placing it does not need a virtual call.
    *  @return returns the Opcode of the instruction
    */
-  virtual Opcode getOpcode() = 0;
+  Opcode getOpcode() const { return opcode; }
 
-  virtual Coordinate_t getCoordinates() { return Coordinate_t(0, 0); };
+  /** @return coordinates used to place the instruction in the overlay */
+  Coordinate_t getCoordinates() const { return coord; }
 
-private:
+  /** @brief appends a compact binary form of the instruction to out. Two
+   *  instructions are identical iff their binary forms are equal.
+   */
+  virtual void serialize(std::string &out) const = 0;
+  /** @brief rebuilds an instruction from its binary form
+   *  @param in start of the binary form, moved past it
+   *  @param end end of the buffer
+   *  @return the instruction, null if the binary form is malformed
+   */
+  static std::unique_ptr<Inst_t> deserialize(const char *&in,
+                                             const char *end);
+
+protected:
+  Opcode opcode;
+  Coordinate_t coord;
 };
 
 /** Switch instruction used for SwitchBox configuration */
 class Switch : public Inst_t {
 public:
-  /** enum class for pin locations */
+  /** enum class for pin locations: North, South, West and East */
   enum TLoc { _d0_, _d1_, _d2_, _d3_, _FLOAT_ };
 
   /** a wrapper for switch instruction operators */
@@ -92,9 +112,6 @@ public:
   /** constructor for Switch instruction class */
   Switch(char in_alignment, int in_track, Coordinate_t in_coord,
          char out_alignment, int out_track, Coordinate_t out_coord);
-  /** @return Opcode of the instruction */
-  Opcode getOpcode() override { return _switch_; };
-
   /** @brief a function that generates human readable instruction
    *  The string follows the format:
    *    switch ${LOC1}{TRACK1} ${LOC2}{TRACK2} #comment
@@ -102,15 +119,23 @@ public:
    *  @return returns a string representing the instruction
    */
   std::string getStr() override;
-
-  /** @return coordinates of the switch box
-   */
-  Coordinate_t getCoordinates() override;
+  void serialize(std::string &out) const override;
+  /** @brief rebuilds a switch, see Inst_t::deserialize */
+  static std::unique_ptr<Inst_t> deserialize(const char *&in,
+                                             const char *end);
+
+  /** @return index of the SwitchBox field driven by this switch */
+  int field(int width) const { return op2.loc * width + op2.number; }
+  /** @return value of the SwitchBox field driven by this switch */
+  uint16_t value() const { return 0x8000 | op1.loc << 13 | op1.number; }
+  /** @return largest track number used by the switch */
+  int track() const { return MAX(op1.number, op2.number); }
 
 private:
+  Switch() : Inst_t(_switch_){};
+
   Operand op1;
   Operand op2;
-  Coordinate_t coord;
 
   /** @brief  Returns the coordinate of the SwitchBox between two channels
    *  @param pos1 position of the first channel
@@ -131,23 +156,53 @@ public:
     std::string name;
   };
 
-  Connect(char pin_dir, std::string pin_name, int pin_idx, Coordinate_t pin_pos,
-          char aligment, int track_num, Coordinate_t track_pos);
-  /** @return Opcode of the instruction */
-  Opcode getOpcode() override { return opcode; };
-  std::string getStr() override;
-  /** @return coordinates of the switch box
+  /** @brief construct the connect instruction
+   *  @param pin_dir 'O' for OPIN to track and 'I' for track to IPIN
+   *  @param pin_name port name of the pin
+   *  @param pin_idx index of the pin in its port
+   *  @param pin_num physical pin number of the pin in the tile (VPR's Pin:)
+   *  @param pin_pos coordinates of the CU
+   *  @param aligment 'X' or 'Y' for the channel of the track
+   *  @param track_num track number in the channel
+   *  @param track_pos coordinates of the channel
    */
-  Coordinate_t getCoordinates() override;
+  Connect(char pin_dir, std::string pin_name, int pin_idx, int pin_num,
+          Coordinate_t pin_pos, char aligment, int track_num,
+          Coordinate_t track_pos);
+  std::string getStr() override;
+  void serialize(std::string &out) const override;
+  /** @brief rebuilds a connect, see Inst_t::deserialize */
+  static std::unique_ptr<Inst_t> deserialize(const char *&in,
+                                             const char *end);
   /** @return 1 if its an input to CU else 0*/
-  bool is_input() { return connection_op.in_connection; }
+  bool is_input() const { return connection_op.in_connection; }
+
+  /** @return index of the field in the CBIn section for inputs or the
+   *  CBOut section for outputs. One track position feeds the pins of up to
+   *  four ComputeUnits, told apart by the side.
+   */
+  int field(int width, int pins) const {
+    return is_input() ? switch_op.loc * pins + pin_num
+                      : switch_op.loc * width + switch_op.number;
+  }
+  /** @return value of the ConnectionBox field */
+  uint16_t value() const {
+    return is_input() ? 0x8000 | switch_op.loc << 13 | switch_op.number
+                      : 0x8000 | pin_num;
+  }
+  /** @return track number of the connection */
+  int track() const { return switch_op.number; }
+  /** @return physical pin number of the connection */
+  int pin() const { return pin_num; }
 
 private:
+  Connect(){};
+
   Switch::Operand switch_op;
   Operand connection_op;
+  int pin_num;
   Coordinate_t connection_coord;
   Coordinate_t switch_coord;
-  Opcode opcode;
 };
 
 class Bind : public Inst_t {
@@ -161,25 +216,32 @@ public:
    *  @param component name of the bound component
    *  @param pin_name name of the bound pin
    *  @param pin_index index_number for the pin
+   *  @param pin_num physical pin number of the pin in the tile (VPR's Pin:)
    *  @param pos coordinates of the CU
    *  @param dir bind direction, 'O' for outbound and 'I' for inbound
    */
   Bind(std::string component_name, std::string pin_name, int pin_index,
-       Coordinate_t pos, char dir);
-
-  /** @return Opcode of the instruction */
-  Opcode getOpcode() override { return _bind_; }
-
-  /** @return coordinates of the corresponding CU */
-  Coordinate_t getCoordinates() override { return coord; }
+       int pin_num, Coordinate_t pos, char dir);
 
   /** @return string representation of the instruction */
   std::string getStr() override;
+  void serialize(std::string &out) const override;
+  /** @brief rebuilds a bind, see Inst_t::deserialize */
+  static std::unique_ptr<Inst_t> deserialize(const char *&in,
+                                             const char *end);
+
+  /** @return physical pin number of the bound pin */
+  int pin() const { return pin_num; }
+  /** @return 32 bit id of the bound component, never 0 */
+  uint32_t id() const { return component_id; }
 
 private:
+  Bind() : Inst_t(_bind_){};
+
   Bind::Operand component;
-  Bind::Operand pin;
-  Coordinate_t coord;
+  Bind::Operand pin_op;
+  int pin_num;
+  uint32_t component_id;
   bool outbound;
 };
 
@@ -192,6 +254,13 @@ public:
   Config_t(){};
   void push_back(std::unique_ptr<Instructions::Inst_t> inst);
   void print_instructions();
+  /** @brief calls f on every instruction, in insertion order */
+  template <class F> void for_each(F f) {
+    for (auto iter = instructions.begin(); iter != instructions.end(); iter++)
+      f((*iter).get());
+  }
+  /** @return 1 if the config has no instruction */
+  bool empty() const { return instructions.empty(); }
 
 private:
   // Device specific bit-stream
@@ -10,37 +10,75 @@
 #ifndef __OVERLAY_H__
 #define __OVERLAY_H__
 
+#include "Arch.h"
 #include "Units.h"
+#include <mutex>
+#include <string>
 #include <vector>
 
 /** @brief Class declaration for a block.
  *
- *  Each block has:
+ *  The units of a block are given by the architecture. The classic tile
+ *  has:
  *    2 ConnectionBox
  *    1 SwitchBox
  *    1 ComputeUnit
+ *
+ *  A block holds one configuration per context of a multi-context overlay.
+ *  Contexts with identical configurations share one storage slot of the
+ *  units, see set_slots().
  */
 
 class Block {
 public:
   /** @brief Initializes a block at the given coordinates
    *  @param coordinates coordinates of the block in the overlay
+   *  @param arch architecture of the tile, has to outlive the block
+   *  @param contexts number of configuration contexts
    */
-  Block(Coordinate_t coordinates);
+  Block(Coordinate_t coordinates, const Arch &arch, int contexts = 1);
   /** @return returns the block coordinates */
   Coordinate_t getCoordinates();
   /** @brief pushes an instruction into its corresponding unit
    *  @param inst instruction reference to be inserted
+   *  @param context configuration context of the instruction
    */
-  void push_back(std::unique_ptr<Instructions::Inst_t> inst);
+  void push_back(std::unique_ptr<Instructions::Inst_t> inst,
+                 int context = 0);
+  /** @brief quiet push_back for the bulk paths, which already know the
+   *  unit. Nothing is printed so parallel callers do not contend on
+   *  stderr.
+   *  @param slot index of the unit in the tile, see RouteRule
+   */
+  void append(int slot, std::unique_ptr<Instructions::Inst_t> inst,
+              int context) {
+    units[slot]->push_back(std::move(inst), context_slot[context]);
+  }
 
-  void print_instructions();
+  void print_instructions(int context = 0);
+  /** @brief calls f on every instruction of a context, unit by unit */
+  template <class F> void for_each(F f, int context = 0) {
+    for (auto iter = units.begin(); iter != units.end(); iter++)
+      (*iter)->for_each(f, context_slot[context]);
+  }
+  /** @brief assigns the contexts to storage slots, contexts with equal
+   *  slots share one configuration. Must run before any instruction is
+   *  pushed.
+   *  @param slot_of slot of every context
+   *  @param slots number of slots
+   */
+  void set_slots(const std::vector<int> &slot_of, int slots);
+  /** @return number of configuration contexts */
+  int getContexts() { return context_slot.size(); }
+  /** @return storage slot of a context, equal slots mean equal configs */
+  int getSlot(int context) { return context_slot[context]; }
+  /** @return 1 if no context configures any unit of the block */
+  bool empty() const;
 
 private:
-  std::unique_ptr<ConnectionBox> CBIn;
-  std::unique_ptr<ConnectionBox> CBOut;
-  std::unique_ptr<SwitchBox> SB;
-  std::unique_ptr<ComputeUnit> CU;
+  std::vector<std::unique_ptr<AbstractUnit>> units;
+  std::vector<int> context_slot;
+  const Arch *arch;
   Coordinate_t coord;
 };
 
@@ -49,20 +87,106 @@ public:
   /** @brief Initializes the BLOCKS in the overlay
    *  @param rows number of rows of the overlay. The same as VPR.
    *  @param cols number of columns of the overlay. The same as VPR.
+   *  @param arch architecture of the tiles
+   *  @param contexts number of configuration contexts
+   *  @param origin coordinates of the first block. A region of a larger
+   *         overlay keeps the coordinates of the whole overlay.
+   */
+  Overlay(int rows, int cols, const Arch &arch = Arch(), int contexts = 1,
+          Coordinate_t origin = Coordinate_t());
+  /** @brief the blocks point at arch, so an overlay stays where it is
+   *  built
    */
-  Overlay(int rows, int cols);
+  Overlay(const Overlay &) = delete;
+  Overlay(Overlay &&) = delete;
+  Overlay &operator=(const Overlay &) = delete;
+  Overlay &operator=(Overlay &&) = delete;
   /** @brief pushes back and instruction into the Overlay.
    *  The logical location of the instruction is embedded in the instruction
    *  class and is used here.
    *  @param inst instruction reference to be inserted into the overlay.
    */
   void push_back(std::unique_ptr<Instructions::Inst_t> inst);
+  /** @brief thread-safe version of push_back for parallel producers.
+   *  Instructions are buffered in per-row shards, each with its own lock,
+   *  and only reach their blocks in freeze(). A shard keeps every distinct
+   *  instruction once, in its binary form, whatever the number of contexts
+   *  pushing it.
+   *  @param inst instruction reference to be inserted into the overlay.
+   *  @param seq order of the instruction in its unit after freeze(). Keys
+   *         have to be unique, e.g. (producer << 40) | local counter, for
+   *         the order to be deterministic.
+   *  @param context configuration context of the instruction
+   */
+  void push_back(std::unique_ptr<Instructions::Inst_t> inst, uint64_t seq,
+                 int context = 0);
+  /** @brief moves all concurrently pushed instructions into their blocks
+   *  in seq order. Identical configurations of the contexts of a block are
+   *  built only once and share a slot. Must not run while producers are
+   *  still pushing.
+   */
+  void freeze();
+
+  /** @brief bulk version of push_back for a whole routing at once.
+   *  Instructions are packed into (block, unit) keyed records, radix
+   *  sorted in parallel and every block then takes its sorted range. Each
+   *  unit ends up with the same instructions in the same order as pushing
+   *  them one by one.
+   *  @param insts instructions in routing order
+   *  @param context configuration context of the instructions
+   *  @param threads maximum number of threads, NumThreads() if 0
+   */
+  void bulk_load(std::vector<std::unique_ptr<Instructions::Inst_t>> insts,
+                 int context = 0, int threads = 0);
 
   void print_instructions();
+  /** @return index of the block the instruction is placed into */
+  int blockIndex(const Instructions::Inst_t &inst);
+  /** @return block at the given index, index = x + y * cols */
+  Block &getBlock(int index) { return blocks.at(index); }
+  int getRows() { return rows; }
+  int getCols() { return cols; }
+  int getContexts() { return contexts; }
+  Coordinate_t getOrigin() { return origin; }
+  const Arch &getArch() { return arch; }
+
 private:
+  /** @brief an instruction waiting for freeze() */
+  struct Pending {
+    uint64_t seq;
+    uint32_t id; // distinct instruction of the shard
+  };
+  /** @brief an instruction of bulk_load, key = block << 8 | unit slot */
+  struct Placed {
+    uint64_t key;
+    uint32_t inst; // index of the instruction in the input
+  };
+  /** @brief concurrently pushed instructions of one row of blocks */
+  struct Shard {
+    std::mutex lock;
+    std::vector<std::vector<Pending>> pending; // by context
+    // Binary forms of the distinct instructions back to back, form id
+    // spans [starts[id], starts[id + 1])
+    std::string forms;
+    std::vector<uint32_t> starts;
+    std::vector<uint32_t> block_col; // column of the block of every id
+    std::vector<uint32_t> hashes;    // hash of the form of every id
+    std::vector<int32_t> table; // ids by hash of their form, -1 if empty
+  };
+  /** @return id of the distinct instruction form of a shard, added if it
+   *  is new. The shard has to be locked.
+   *  @param hash hash of form, computed by the caller outside of the lock
+   */
+  static uint32_t intern(Shard &shard, const std::string &form,
+                         uint32_t hash, int col);
+
+  Arch arch;
   std::vector<Block> blocks;
+  std::vector<Shard> shards;
   int rows;
   int cols;
+  int contexts;
+  Coordinate_t origin;
 };
 
 #endif // __OVERLAY_H__
@@ -0,0 +1,100 @@
+/** @file Parallel.h
+ *  @brief Small helpers to spread loops over the cores
+ *  @author  Mahyar Emami(mayyxeng)
+ */
+#ifndef __PARALLEL_H__
+#define __PARALLEL_H__
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/** @return number of worker threads to use, at least 1 */
+inline int NumThreads() {
+  int threads = std::thread::hardware_concurrency();
+  return threads > 0 ? threads : 1;
+}
+
+/** @brief Calls f(i) for every i in [0, count) from up to threads
+ *  threads. Workers grab the next grain of indices from a shared counter,
+ *  so uneven work balances itself.
+ *  @param count number of indices
+ *  @param f function called with every index, has to be thread-safe
+ *  @param grain number of indices taken at once
+ *  @param threads maximum number of threads, NumThreads() if 0
+ */
+template <class F>
+void ParallelFor(int count, F f, int grain = 1, int threads = 0) {
+  if (threads <= 0)
+    threads = NumThreads();
+  threads = std::min(threads, (count + grain - 1) / grain);
+  std::atomic<int> next(0);
+  auto worker = [&]() {
+    for (int begin = next.fetch_add(grain); begin < count;
+         begin = next.fetch_add(grain)) {
+      int end = std::min(begin + grain, count);
+      for (int i = begin; i < end; i++)
+        f(i);
+    }
+  };
+  if (threads <= 1) {
+    worker();
+    return;
+  }
+  std::vector<std::thread> pool;
+  for (int t = 1; t < threads; t++)
+    pool.emplace_back(worker);
+  worker();
+  for (auto &thread : pool)
+    thread.join();
+}
+
+/** @brief Stable LSD radix sort of items by an unsigned key, one byte of
+ *  the key per pass. Every pass splits items into one chunk per thread,
+ *  counts the digits of each chunk, then scatters the chunks in parallel
+ *  to their precomputed offsets, so reads and writes stay sequential.
+ *  @param items items to sort, sorted on return
+ *  @param key function returning the key of an item
+ *  @param key_bits number of significant bits of the keys
+ *  @param threads maximum number of threads, NumThreads() if 0
+ */
+template <class T, class Key>
+void ParallelRadixSort(std::vector<T> &items, Key key, int key_bits,
+                       int threads = 0) {
+  const int radix = 256;
+  int count = items.size();
+  if (threads <= 0)
+    threads = NumThreads();
+  // Small chunks are not worth a thread
+  int chunks = std::max(1, std::min(threads, count / 4096));
+  std::vector<T> buf(count);
+  std::vector<int> offsets(chunks * radix);
+  auto begin = [&](int chunk) { return (int)((long)count * chunk / chunks); };
+
+  for (int shift = 0; shift < key_bits; shift += 8) {
+    std::fill(offsets.begin(), offsets.end(), 0);
+    ParallelFor(chunks, [&](int chunk) {
+      int *hist = &offsets[chunk * radix];
+      for (int i = begin(chunk); i < begin(chunk + 1); i++)
+        hist[(key(items[i]) >> shift) & (radix - 1)]++;
+    }, 1, chunks);
+    // Digit major, chunk minor keeps equal keys in their order
+    int sum = 0;
+    for (int digit = 0; digit < radix; digit++)
+      for (int chunk = 0; chunk < chunks; chunk++) {
+        int n = offsets[chunk * radix + digit];
+        offsets[chunk * radix + digit] = sum;
+        sum += n;
+      }
+    ParallelFor(chunks, [&](int chunk) {
+      int *next = &offsets[chunk * radix];
+      for (int i = begin(chunk); i < begin(chunk + 1); i++)
+        buf[next[(key(items[i]) >> shift) & (radix - 1)]++] =
+            std::move(items[i]);
+    }, 1, chunks);
+    items.swap(buf);
+  }
+}
+
+#endif // __PARALLEL_H__
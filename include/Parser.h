@@ -5,10 +5,14 @@
 #ifndef __PARSER_H__
 #define __PARSER_H__
 
+#include "ChannelStats.h"
 #include "Overlay.h"
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <regex>
+#include <string>
+#include <vector>
 
 
 
@@ -22,14 +26,145 @@ enum parse_state_t {
   _init_ // Inital state
 };
 
+/** @brief Kinds of decoded *.route lines and binary route records */
+enum route_kind_t {
+  _route_array_,  // Array size: rows x cols logic blocks
+  _route_net_,    // Net header
+  _route_source_, // SOURCE node
+  _route_sink_,   // SINK node
+  _route_opin_,   // OPIN node
+  _route_ipin_,   // IPIN node
+  _route_chanx_,  // CHANX node
+  _route_chany_,  // CHANY node
+  _route_other_   // anything else
+};
+
+/** @brief A decoded line of the routing, from the text or the binary
+ *  front end
+ */
+struct RouteNode {
+  route_kind_t kind;
+  int id;           // VPR node id
+  int x;            // x of the node, rows of an array
+  int y;            // y of the node, cols of an array
+  int track_or_pin; // track of a channel, pin number of a pin
+  int port_index;   // index of a pin in its port
+  std::string port; // port name of a pin, tail component of a net
+  std::string head; // head component of a net
+};
+
+/** @brief A pin of a ComputeUnit, pin is the physical pin number */
+struct RoutePin {
+  int x;
+  int y;
+  int pin;
+};
+
+/** @brief Terminals of a routed net, what the configuration has to
+ *  connect
+ */
+struct RouteNet {
+  std::string name;
+  RoutePin source;              // x is -1 until the OPIN is seen
+  std::vector<RoutePin> sinks;
+};
+
+/** @brief decodes one line of a *.route file
+ *  @param line the text line
+ *  @param node decoded line, kind is _route_other_ for unknown lines
+ */
+void DecodeRouteLine(const std::string &line, RouteNode &node);
+
+/** @brief RouteBuilder turns the sequence of nodes of the nets into
+ *  Switch, Connect and Bind instructions. Both front ends feed it.
+ */
+class RouteBuilder {
+public:
+  typedef std::function<void(std::unique_ptr<Instructions::Inst_t>)> Emit;
+  /** @param arch architecture used for the pin map
+   *  @param emit called with every instruction built
+   */
+  RouteBuilder(const Arch &arch, Emit emit);
+  /** @brief feeds the next node of the routing, arrays are ignored */
+  void push(const RouteNode &node);
+  /** @brief also records the terminals of every net into nets */
+  void setNets(std::vector<RouteNet> *nets) { this->nets = nets; }
+  /** @brief also counts the uses of every track into stats */
+  void setStats(ChannelStats *stats) { this->stats = stats; }
+
+private:
+  const Arch &arch;
+  Emit emit;
+  std::vector<RouteNet> *nets;
+  ChannelStats *stats;
+  RouteNode prev;
+  parse_state_t prev_state;
+  std::string net_head;
+  std::string net_tail;
+};
+
 /** @brief ParseFiles reads circuit_name.route and circuit_name.place
  *  files and parses them into Config_t types.
+ *  The route file may be compressed as circuit_name.route.gz or
+ *  circuit_name.route.zst, it is decompressed while being parsed.
  *
  *  @param cirtcuit_name name of the VPRs output file name without .route
  *         or .place format identifiers.
+ *  @param arch architecture of the overlay tiles
+ *  @param nets if given, filled with the terminals of the nets
+ *  @param stats if given, filled with the channel utilization
  *  @return Overlay pointer to the configured Overlay class
  */
-Overlay *ParseFiles(const char* circuit_name);
+Overlay *ParseFiles(const char *circuit_name, const Arch &arch = Arch(),
+                    std::vector<RouteNet> *nets = nullptr,
+                    ChannelStats *stats = nullptr);
+
+/** @brief ParseContexts parses several circuits as the configuration
+ *  contexts of one overlay. Every circuit is parsed by its own thread
+ *  straight into the shared overlay and identical block configurations
+ *  across contexts are stored once.
+ *
+ *  @param circuits names of the circuits, circuit i is context i. All of
+ *         them have to be routed on the same array.
+ *  @param arch architecture of the overlay tiles
+ *  @param stats if given, filled with the channel utilization summed over
+ *         the contexts. Every thread counts on its own, the counts are
+ *         merged at the end.
+ *  @return Overlay pointer to the configured multi-context Overlay
+ */
+Overlay *ParseContexts(const std::vector<std::string> &circuits,
+                       const Arch &arch = Arch(),
+                       ChannelStats *stats = nullptr);
+
+/** @brief ParseRecords reads the routing as fixed-size binary records,
+ *  see RouteRecord.h, and builds the same instructions as ParseFiles
+ *  without any text formatting or parsing.
+ *
+ *  @param source a binary route file written by route2bin, or shm:name
+ *         for a shared-memory ring fed by a producer
+ *  @param arch architecture of the overlay tiles
+ *  @param nets if given, filled with the terminals of the nets
+ *  @param stats if given, filled with the channel utilization
+ *  @return Overlay pointer to the configured Overlay class
+ */
+Overlay *ParseRecords(const char *source, const Arch &arch = Arch(),
+                      std::vector<RouteNet> *nets = nullptr,
+                      ChannelStats *stats = nullptr);
+
+/** @brief ParseInstructions streams the instructions of a routing without
+ *  building an overlay, for callers that place them on their own.
+ *
+ *  @param source circuit name as for ParseFiles, or a records source as
+ *         for ParseRecords
+ *  @param records 1 if source holds binary route records
+ *  @param arch architecture of the overlay tiles
+ *  @param on_array called with the rows and columns of the array before
+ *         the first instruction
+ *  @param emit called with every instruction, in routing order
+ */
+void ParseInstructions(const char *source, bool records, const Arch &arch,
+                       std::function<void(int, int)> on_array,
+                       RouteBuilder::Emit emit);
 
 /** @brief  Returns the coordinate of the SwitchBox between two channels
  *  @param pos1 position of the first channel
@@ -0,0 +1,97 @@
+/** @file Partition.h
+ *  @brief Region-partitioned emission of the bitstream images of an overlay
+ *
+ *  Large overlays are split into a grid of rectangular regions of blocks,
+ *  each written to its own image so it can be sent to its own device, or
+ *  built without holding the whole overlay in memory. While the routing is
+ *  parsed every instruction is serialized into the temporary run file of
+ *  the region of its block. The regions are then loaded back from their
+ *  runs and written independently, by several workers at once.
+ *
+ *  All region images share the frame layout of the whole overlay, so frame
+ *  (x, y) of a region image is frame (x0 + x, y0 + y) of the full image.
+ *  The regions are listed in prefix.regions:
+ *
+ *    array rows cols
+ *    image x0 y0 rows cols     one line per region, row by row
+ *
+ *  @author  Mahyar Emami(mayyxeng)
+ */
+#ifndef __PARTITION_H__
+#define __PARTITION_H__
+
+#include "Arch.h"
+#include "Config.h"
+#include <memory>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/** @brief Split of an array of blocks into a grid of regions */
+class RegionGrid {
+public:
+  /** @brief splits rows x cols blocks into grid_rows x grid_cols regions,
+   *  sizes differ by one block at most
+   */
+  RegionGrid(int rows, int cols, int grid_rows, int grid_cols);
+  /** @return number of regions, numbered row by row */
+  int regions() const { return grid_rows * grid_cols; }
+  /** @return region of the block at coordinates, -1 if it is outside */
+  int regionOf(Coordinate_t block) const;
+  /** @return coordinates of the first block of region */
+  Coordinate_t origin(int region) const;
+  int getRows(int region) const;
+  int getCols(int region) const;
+
+private:
+  int grid_rows;
+  int grid_cols;
+  std::vector<int> row_start; // first row of every region row, then rows
+  std::vector<int> col_start; // first column of every region column
+  std::vector<int> row_region; // region row of every row
+  std::vector<int> col_region; // region column of every column
+};
+
+/** @brief Instructions of one region spilled to an unlinked temporary file
+ *  in $TMPDIR, or /tmp, in their binary form
+ */
+class RunFile {
+public:
+  RunFile();
+  ~RunFile();
+  RunFile(const RunFile &) = delete;
+  RunFile &operator=(const RunFile &) = delete;
+
+  /** @brief appends inst to the run */
+  void append(const Instructions::Inst_t &inst);
+  /** @return the instructions of the run in the order they were appended,
+   *  the run is emptied
+   */
+  std::vector<std::unique_ptr<Instructions::Inst_t>> load();
+  /** @return number of instructions in the run */
+  size_t size() const { return count; }
+
+private:
+  FILE *file;
+  std::string bytes; // binary form of the instruction being appended
+  size_t count;
+};
+
+/** @brief Parses a routing and writes the image of every region of a
+ *  grid_rows x grid_cols grid to prefix.ry.rx, see the file description.
+ *  @param source circuit name, or records source if records
+ *  @param records 1 if source holds binary route records
+ *  @param arch architecture of the overlay tiles
+ *  @param grid_rows number of regions along the rows
+ *  @param grid_cols number of regions along the columns
+ *  @param prefix prefix of the images and of the region list
+ *  @param jobs number of regions built at once, each worker keeps only
+ *         its region in memory. The threads are split between the
+ *         workers.
+ *  @return number of frames written
+ */
+int EmitRegions(const char *source, bool records, const Arch &arch,
+                int grid_rows, int grid_cols, const char *prefix,
+                int jobs = 1);
+
+#endif // __PARTITION_H__
@@ -0,0 +1,150 @@
+/** @file RouteRecord.h
+ *  @brief Binary route records exchanged with the router
+ *
+ *  Instead of writing and parsing *.route text, a producer can hand the
+ *  routing over as a sequence of fixed-size 32 byte records, either in a
+ *  binary file or through a shared-memory ring. Every record is one
+ *  RouteNode:
+ *
+ *    node_id       VPR node id
+ *    kind          route_kind_t of the node, or a _record_kind_t
+ *    port_index    index of a pin in its port
+ *    x, y          coordinates, rows and cols of an array
+ *    track_or_pin  track of a channel, pin number of a pin
+ *    name_id       port name of a pin, tail component of a net
+ *    aux           head component of a net
+ *
+ *  Names are interned, a _record_name_ record with the name_id and the
+ *  length in aux is followed by the raw bytes of the name padded to whole
+ *  records. It comes before the first record using the name. The stream
+ *  ends with an _record_end_ record.
+ *
+ *  A binary file starts with a 32 byte header, magic "BSMKRTE", then holds
+ *  the records. A ring lives in the POSIX shared memory object /name, see
+ *  RecordRing. All values are in the host byte order.
+ *
+ *  @author  Mahyar Emami(mayyxeng)
+ */
+#ifndef __ROUTE_RECORD_H__
+#define __ROUTE_RECORD_H__
+
+#include "Parser.h"
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/** @brief Record kinds that are not nodes, after the route_kind_t values */
+enum record_kind_t {
+  _record_name_ = 16, // interned name, followed by its bytes
+  _record_end_ = 17   // end of the routing
+};
+
+/** @brief A fixed-size binary route record */
+struct RouteRecord {
+  uint32_t node_id;
+  uint8_t kind;
+  uint8_t reserved;
+  uint16_t port_index;
+  int32_t x;
+  int32_t y;
+  int32_t track_or_pin;
+  uint32_t name_id;
+  uint32_t aux;
+  uint32_t reserved2;
+};
+static_assert(sizeof(RouteRecord) == 32, "RouteRecord must be 32 bytes");
+
+/** @brief Header of a binary route file */
+struct RecordFileHeader {
+  char magic[8]; // "BSMKRTE\0"
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t reserved[2];
+};
+
+/** @brief Header of a shared-memory ring of records. The producer only
+ *  moves head and the consumer only moves tail, each on its own cache
+ *  line, so the ring needs no lock. Both publish their position in
+ *  batches.
+ */
+struct RecordRing {
+  char magic[8]; // "BSMKRNG\0", written last by the producer
+  uint32_t record_size;
+  uint32_t capacity; // number of records, a power of 2
+  uint32_t producer; // process id of the producer, 0 if unknown
+  std::atomic<uint32_t> consumer; // process id of the consumer, 0 until
+                                  // it attaches
+  alignas(64) std::atomic<uint64_t> head; // records written
+  alignas(64) std::atomic<uint64_t> tail; // records consumed
+  alignas(64) RouteRecord records[1];     // capacity records
+};
+
+/** @brief RecordWriter writes nodes as records into a binary file or a
+ *  shared-memory ring
+ */
+class RecordWriter {
+public:
+  /** @brief Creates the output
+   *  @param target file name, or shm:name to create the ring /name
+   *  @param capacity number of records of a ring
+   */
+  RecordWriter(const char *target, uint32_t capacity = 1 << 16);
+  /** @brief writes the end record and closes the output */
+  ~RecordWriter();
+  /** @brief writes node, interning its names. Exits if the ring stays
+   *  full while its consumer is dead, or never attached within
+   *  RING_ATTACH_TIMEOUT seconds.
+   */
+  void push(const RouteNode &node);
+
+private:
+  uint32_t intern(const std::string &name);
+  void write(const RouteRecord &record);
+  void flush();
+  /** @brief exits if the consumer of the ring is dead, or has not attached
+   *  since waiting
+   */
+  void checkConsumer(std::chrono::steady_clock::time_point waiting);
+
+  FILE *file;
+  RecordRing *ring;
+  size_t ring_size;
+  std::vector<RouteRecord> buf;
+  std::map<std::string, uint32_t> names;
+};
+
+/** @brief RecordReader reads the nodes back from a binary file, mapped
+ *  into memory, or from a shared-memory ring while it is being filled.
+ */
+class RecordReader {
+public:
+  /** @param source file name, or shm:name to attach to the ring /name.
+   *         The ring is unlinked once attached.
+   */
+  RecordReader(const char *source);
+  ~RecordReader();
+  /** @brief decodes the next node. Exits if the producer of a ring dies
+   *  before the end of the routing.
+   *  @return 0 at the end of the routing
+   */
+  bool next(RouteNode &node);
+
+private:
+  const RouteRecord &read();
+
+  const RouteRecord *records; // records of a file
+  size_t count;
+  size_t pos;
+  RecordRing *ring;
+  RouteRecord current; // record of a ring, copied out of the slot
+  uint64_t published;  // tail last handed back to the producer
+  void *map;
+  size_t map_size;
+  std::vector<std::string> names;
+};
+
+#endif // __ROUTE_RECORD_H__
@@ -0,0 +1,80 @@
+/** @file RouteStream.h
+ *  @brief Streaming reader for plain and compressed *.route files
+ *
+ *  RouteStream is a std::streambuf that is filled by a dedicated decoder
+ *  thread. The decoder reads <circuit>.route, <circuit>.route.gz or
+ *  <circuit>.route.zst and decompresses into a ring of large buffers which
+ *  the parser consumes directly. Nothing is ever written to disk.
+ *
+ *  @author  Mahyar Emami(mayyxeng)
+ */
+#ifndef __ROUTE_STREAM_H__
+#define __ROUTE_STREAM_H__
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** @brief Compression formats understood by RouteStream */
+enum route_format_t {
+  _plain_, // <circuit>.route
+  _gzip_,  // <circuit>.route.gz
+  _zstd_   // <circuit>.route.zst
+};
+
+/** @brief Abstract decoder that produces the decompressed route text */
+class RouteSource {
+public:
+  virtual ~RouteSource(){};
+  /** @brief reads up to size decompressed bytes into buf
+   *  @return number of bytes read, 0 on end of file
+   */
+  virtual size_t read(char *buf, size_t size) = 0;
+};
+
+class RouteStream : public std::streambuf {
+public:
+  /** @brief Opens path and starts the decoder thread
+   *  @param path file name, the format is derived from its extension
+   *  @param chunk_size size of each buffer in the ring
+   *  @param chunks number of buffers in the ring
+   */
+  RouteStream(const std::string &path, size_t chunk_size = 4 << 20,
+              int chunks = 4);
+  ~RouteStream();
+
+  /** @brief Finds the route file for a circuit. The plain file is
+   *  preferred, then .route.gz and .route.zst.
+   *  @param circuit_name name of the circuit without format identifiers
+   *  @return path of the route file or an empty string if none exists
+   */
+  static std::string Locate(const char *circuit_name);
+
+  /** @return format of the file according to its extension */
+  static route_format_t FormatOf(const std::string &path);
+
+protected:
+  int_type underflow() override;
+
+private:
+  /** @brief decoder thread body, fills the ring until end of file */
+  void decode();
+
+  std::unique_ptr<RouteSource> source;
+  std::vector<std::vector<char>> ring;
+  std::vector<size_t> filled; // valid bytes of each buffer
+  int head;                   // buffer being consumed
+  int count;                  // number of full buffers
+  bool consuming;             // head is handed to the parser
+  bool done;                  // decoder reached end of file
+  bool stop;                  // reader is going away
+  std::mutex lock;
+  std::condition_variable cond;
+  std::thread decoder;
+};
+
+#endif // __ROUTE_STREAM_H__
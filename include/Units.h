@@ -20,16 +20,27 @@ class Block; // forward declaration
 class AbstractUnit {
 
 public:
-  AbstractUnit(){local_coord = Coordinate_t(0, 0);};
-  AbstractUnit(Coordinate_t coord):local_coord(coord){};
+  AbstractUnit():configs(1){local_coord = Coordinate_t(0, 0);};
+  AbstractUnit(Coordinate_t coord):configs(1),local_coord(coord){};
+  virtual ~AbstractUnit(){};
   /** @brief append a config instruction
    *  @param inst new instruction to append
+   *  @param slot configuration slot, see Block
    */
-  void push_back(std::unique_ptr<Instructions::Inst_t> inst);
+  void push_back(std::unique_ptr<Instructions::Inst_t> inst, int slot = 0);
   
-  void print_instructions();
+  void print_instructions(int slot = 0);
+  /** @brief calls f on every instruction of a configuration slot */
+  template <class F> void for_each(F f, int slot = 0) {
+    configs[slot].for_each(f);
+  }
+  /** @return 1 if a configuration slot has no instruction */
+  bool empty(int slot = 0) const { return configs[slot].empty(); }
+  /** @brief sets the number of configuration slots */
+  void resize(int slots) { configs.resize(slots); }
 protected:
-  Config_t config;
+  // One configuration per distinct configuration context of the block
+  std::vector<Config_t> configs;
   Coordinate_t local_coord;
 
 };
@@ -0,0 +1,90 @@
+/** @file Verify.h
+ *  @brief Connectivity check of a configured overlay or bitstream image
+ *
+ *  Every configured SwitchBox and ConnectionBox field joins two routing
+ *  nodes: tracks of the channels and pins of the ComputeUnits. The nodes are
+ *  merged in a flat union-find, then every sink of a net has to be in the
+ *  set of its source and no two nets may share a set.
+ *
+ *  Channel side of the SwitchBox at (x, y), see Switch:
+ *    _d0_ CHANY (x, y + 1)    _d1_ CHANY (x, y)
+ *    _d2_ CHANX (x, y)        _d3_ CHANX (x + 1, y)
+ *  Channel side of the ComputeUnit at (x, y), see Connect:
+ *    _d0_ CHANX (x, y)        _d1_ CHANX (x, y - 1)
+ *    _d2_ CHANY (x - 1, y)    _d3_ CHANY (x, y)
+ *
+ *  @author  Mahyar Emami(mayyxeng)
+ */
+#ifndef __VERIFY_H__
+#define __VERIFY_H__
+
+#include "Bitstream.h"
+#include "Parser.h"
+#include <iostream>
+#include <vector>
+
+class Connectivity {
+public:
+  /** @brief Creates the routing nodes of an overlay, all unconnected
+   *  @param rows rows of the overlay
+   *  @param cols columns of the overlay
+   *  @param layout channel width and pins of the configuration
+   */
+  Connectivity(int rows, int cols, const FrameLayout &layout);
+
+  /** @brief joins the nodes connected by a frame field
+   *  @param section section of the field, _cu_ fields are ignored
+   *  @param pos position of the SwitchBox for _sb_ fields, of the track
+   *         for _cb_in_ fields and of the ComputeUnit for _cb_out_ fields,
+   *         the coordinates of the instruction
+   *  @param field index of the field in the section
+   *  @param value value of the field, unset fields are ignored
+   */
+  void connect(frame_section_t section, Coordinate_t pos, int field,
+               uint16_t value);
+  /** @brief joins the nodes connected by the instructions of a context */
+  void addOverlay(Overlay &overlay, int context = 0);
+  /** @brief joins the nodes connected by the frames of a context of an
+   *  image, the blocks of the frames are given by arch
+   */
+  void addBitstream(BitstreamFile &image, const Arch &arch, int context = 0);
+
+  /** @brief checks the nets against the connections
+   *  @param nets expected nets
+   *  @param out stream the errors are reported to
+   *  @return number of unreachable sinks plus number of shorted nets
+   */
+  int check(const std::vector<RouteNet> &nets, std::ostream &out);
+
+private:
+  int find(int node);
+  void unite(int a, int b);
+  /** @return node of a track, -1 if it is outside of the overlay */
+  int track(bool chanx, int x, int y, int track);
+  /** @return node of a pin, -1 if it is outside of the overlay */
+  int pin(int x, int y, int pin);
+
+  // Coordinates are stored shifted by 1 so the border channels fit
+  int dim_x;
+  int dim_y;
+  int width;
+  int pins;
+  int pin_base; // first pin node, tracks come first
+  std::vector<int> parent;
+  std::vector<int> rank;
+  int invalid; // fields pointing outside of the overlay
+};
+
+/** @brief Verifies the connectivity of a context of overlay
+ *  @return number of errors, 0 if every net is routed as expected
+ */
+int VerifyOverlay(Overlay &overlay, const std::vector<RouteNet> &nets,
+                  int context = 0);
+
+/** @brief Verifies the connectivity of a context of a bitstream image
+ *  @return number of errors, 0 if every net is routed as expected
+ */
+int VerifyBitstream(const char *path, const Arch &arch,
+                    const std::vector<RouteNet> &nets, int context = 0);
+
+#endif // __VERIFY_H__
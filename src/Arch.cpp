@@ -0,0 +1,214 @@
+/** @file Arch.cpp
+ *  @brief Architecture description loading from config and VPR XML files
+ *  @author Mahyar Emami (mayyxeng)
+ */
+#include "Arch.h"
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+
+static const char *OPCODE_NAMES[] = {"switch", "connect_to", "connect_from",
+                                     "set",    "bind",       "null"};
+
+Arch::Arch() : channel_width(0), num_pins(0) {
+  units.push_back({"SB", _switch_box_, Coordinate_t(0, 0)});
+  units.push_back({"CBIn", _connection_box_, Coordinate_t(0, 1)});
+  units.push_back({"CBOut", _connection_box_, Coordinate_t(1, 0)});
+  units.push_back({"CU", _compute_unit_, Coordinate_t(1, 1)});
+  for (auto &rule : rules)
+    rule = {-1, Coordinate_t(-1, -1)};
+  rules[Instructions::_switch_] = {0, Coordinate_t(0, 0)};
+  rules[Instructions::_connect_to_] = {1, Coordinate_t(0, -1)};
+  rules[Instructions::_connect_from_] = {2, Coordinate_t(1, 0)};
+  rules[Instructions::_bind_] = {3, Coordinate_t(-1, -1)};
+}
+
+void Arch::clear() {
+  units.clear();
+  for (auto &rule : rules)
+    rule = {-1, Coordinate_t(-1, -1)};
+  ports.clear();
+  port_index.clear();
+  num_pins = 0;
+}
+
+void Arch::addPort(const std::string &name, int pins, bool input) {
+  port_index[name] = ports.size();
+  ports.push_back({name, pins, num_pins, input});
+  num_pins += pins;
+  DPRINTF("Port %s[%d] -> pins %d..%d\n", name.c_str(), pins,
+          num_pins - pins, num_pins - 1);
+}
+
+int Arch::findUnit(const std::string &name) const {
+  for (size_t i = 0; i < units.size(); i++)
+    if (units[i].name == name)
+      return i;
+  return -1;
+}
+
+void Arch::validate(const char *path) const {
+  // Unit kind able to hold each opcode, the others have no frame section
+  const struct {
+    Instructions::Opcode opcode;
+    unit_kind_t kind;
+  } kinds[] = {{Instructions::_switch_, _switch_box_},
+               {Instructions::_connect_to_, _connection_box_},
+               {Instructions::_connect_from_, _connection_box_},
+               {Instructions::_bind_, _compute_unit_}};
+  std::vector<int> routes(units.size(), 0);
+  for (int op = 0; op < Instructions::_null_; op++) {
+    int slot = rules[op].slot;
+    if (slot < 0)
+      continue;
+    routes[slot]++;
+    bool ok = false;
+    for (auto &entry : kinds)
+      ok |= entry.opcode == op && entry.kind == units[slot].kind;
+    if (!ok) {
+      std::cerr << "Error: " << path << ": " << OPCODE_NAMES[op]
+                << " instructions can not be placed into unit "
+                << units[slot].name << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (size_t slot = 0; slot < units.size(); slot++) {
+    if (routes[slot] != 1) {
+      std::cerr << "Error: " << path << ": unit " << units[slot].name
+                << " is the target of " << routes[slot]
+                << " route lines instead of one" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+int Arch::pinNumber(const std::string &port, int index, int vpr_pin) const {
+  if (ports.empty())
+    return vpr_pin;
+  auto iter = port_index.find(port);
+  if (iter == port_index.end() || index >= ports[iter->second].num_pins) {
+    DPRINTF("\n\tError: pin %s[%d] is not in the architecture\n",
+            port.c_str(), index);
+    exit(EXIT_FAILURE);
+  }
+  return ports[iter->second].first_pin + index;
+}
+
+void Arch::parseConfig(std::istream &in, const char *path) {
+  std::string line;
+  int line_num = 0;
+  while (getline(in, line)) {
+    line_num++;
+    line = line.substr(0, line.find('#'));
+    std::istringstream fields(line);
+    std::string key;
+    if (!(fields >> key))
+      continue;
+    bool ok = true;
+    if (key == "channel_width") {
+      ok = bool(fields >> channel_width);
+    } else if (key == "unit") {
+      std::string name, kind;
+      int x, y;
+      ok = bool(fields >> name >> kind >> x >> y);
+      if (ok && kind == "switch_box")
+        units.push_back({name, _switch_box_, Coordinate_t(x, y)});
+      else if (ok && kind == "connection_box")
+        units.push_back({name, _connection_box_, Coordinate_t(x, y)});
+      else if (ok && kind == "compute_unit")
+        units.push_back({name, _compute_unit_, Coordinate_t(x, y)});
+      else
+        ok = false;
+    } else if (key == "route") {
+      std::string opcode, unit;
+      int dx, dy;
+      ok = bool(fields >> opcode >> unit >> dx >> dy);
+      int op = 0;
+      while (op < Instructions::_null_ && opcode != OPCODE_NAMES[op])
+        op++;
+      int slot = findUnit(unit);
+      if (ok && op < Instructions::_null_ && slot >= 0)
+        rules[op] = {slot, Coordinate_t(dx, dy)};
+      else
+        ok = false;
+    } else if (key == "input" || key == "output") {
+      std::string name;
+      int pins;
+      ok = bool(fields >> name >> pins);
+      if (ok)
+        addPort(name, pins, key == "input");
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      std::cerr << "Error: " << path << ":" << line_num
+                << ": invalid architecture line: " << line << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+void Arch::parseVPR(const std::string &text, const char *path,
+                    const std::string &tile) {
+  // The ports of the tile are those of the <tile> (VPR 8) or top level
+  // <pb_type> with the given name, the first one that is not an io if no
+  // name is given. Ports are read up to its first child pb_type or mode.
+  std::smatch match;
+  std::regex re_tile("<(tile|pb_type)\\s+name=\"(\\w+)\"[^>]*>");
+  std::regex re_end("<pb_type\\s|<mode\\s|</tile>|</pb_type>");
+  std::regex re_port("<(input|output|clock)\\s+name=\"(\\w+)\"\\s+"
+                     "num_pins=\"(\\d+)\"");
+  std::regex re_width("<channel_width\\s+value=\"(\\d+)\"");
+
+  auto begin = text.end();
+  for (std::sregex_iterator iter(text.begin(), text.end(), re_tile), last;
+       iter != last; iter++) {
+    auto name = iter->str(2);
+    if (tile.empty() ? name != "io" : name == tile) {
+      begin = (*iter)[0].second;
+      break;
+    }
+  }
+  if (begin == text.end()) {
+    std::cerr << "Error: no tile " << tile << " found in " << path
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  auto end = text.end();
+  if (regex_search(begin, end, match, re_end))
+    end = match.prefix().second;
+  for (std::sregex_iterator iter(begin, end, re_port), last; iter != last;
+       iter++) {
+    auto &port = *iter;
+    addPort(port.str(2), atoi(port.str(3).c_str()), port.str(1) != "output");
+  }
+  // Channel width is not part of VPR architectures, an optional
+  // <channel_width value="W"/> extension is honored
+  if (regex_search(text, match, re_width))
+    channel_width = atoi(match.str(1).c_str());
+}
+
+Arch Arch::Load(const char *path, const std::string &tile) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    std::cerr << "Error: could not open architecture " << path << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  Arch arch;
+  std::string name(path);
+  if (name.size() > 4 && name.compare(name.size() - 4, 4, ".xml") == 0) {
+    // VPR architectures only describe the ComputeUnit, the classic tile
+    // composition is kept
+    std::stringstream text;
+    text << file.rdbuf();
+    arch.parseVPR(text.str(), path, tile);
+  } else {
+    arch.clear();
+    arch.parseConfig(file, path);
+    arch.validate(path);
+  }
+  DPRINTF("\n\tLoaded architecture %s: %zu units, W = %d, %d pins\n", path,
+          arch.units.size(), arch.channel_width, arch.num_pins);
+  return arch;
+}
@@ -0,0 +1,446 @@
+/** @file Bitstream.cpp
+ *  @brief Frame layout, frame encoding and random access image files
+ *  @author Mahyar Emami (mayyxeng)
+ */
+#include "Bitstream.h"
+#include "Parallel.h"
+#include <fcntl.h>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/** @brief On-disk header of a bitstream image, the checksum table starts
+ *  at size and the frames follow it
+ */
+struct BitstreamHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t size;
+  uint32_t rows;
+  uint32_t cols;
+  uint32_t channel_width;
+  uint32_t num_pins;
+  uint32_t frame_words;
+  uint32_t contexts;
+  uint32_t reserved[6];
+};
+
+static const char BITSTREAM_MAGIC[8] = {'B', 'S', 'M', 'K', 'F', 'R', 'M', 0};
+static const uint32_t BITSTREAM_VERSION = 4;
+
+int FrameLayout::fields(frame_section_t section) const {
+  switch (section) {
+  case _sb_:
+  case _cb_out_:
+    return 4 * channel_width;
+  case _cb_in_:
+    return 4 * num_pins;
+  case _cu_:
+    return 2 * num_pins;
+  }
+  return 0;
+}
+
+/** @return number of words taken by a section, 4 fields per word */
+static int SectionWords(const FrameLayout &layout, frame_section_t section) {
+  return (layout.fields(section) + 3) / 4;
+}
+
+int FrameLayout::offset(frame_section_t section) const {
+  int offset = 0;
+  for (int sec = _sb_; sec < section; sec++)
+    offset += SectionWords(*this, (frame_section_t)sec);
+  return offset;
+}
+
+int FrameLayout::words() const {
+  return offset(_cu_) + SectionWords(*this, _cu_);
+}
+
+BitstreamFile::BitstreamFile(const char *path, bool writable)
+    : path(path), writable(writable), frames(nullptr), checksums(nullptr),
+      map_size(0) {
+  fd = open(path, writable ? O_RDWR : O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Error: could not open bitstream " << path << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  BitstreamHeader header;
+  if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      memcmp(header.magic, BITSTREAM_MAGIC, sizeof(BITSTREAM_MAGIC)) != 0 ||
+      header.version != BITSTREAM_VERSION) {
+    std::cerr << "Error: " << path << " is not a bitstream image" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  rows = header.rows;
+  cols = header.cols;
+  contexts = header.contexts;
+  layout = FrameLayout(header.channel_width, header.num_pins);
+  if ((int)header.frame_words != layout.words() || rows < 0 || cols < 0 ||
+      contexts < 1) {
+    std::cerr << "Error: corrupted frame size in " << path << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  // Frames past the end of a short image could not be mapped
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < frameOffset(0, 0, contexts)) {
+    std::cerr << "Error: " << path << " is truncated, "
+              << frameOffset(0, 0, contexts) << " bytes expected"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+BitstreamFile::BitstreamFile(const char *path, int rows, int cols,
+                             const FrameLayout &layout, int contexts)
+    : path(path), writable(true), frames(nullptr), checksums(nullptr),
+      map_size(0), rows(rows), cols(cols), contexts(contexts),
+      layout(layout) {
+  fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cerr << "Error: could not create bitstream " << path << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  BitstreamHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, BITSTREAM_MAGIC, sizeof(BITSTREAM_MAGIC));
+  header.version = BITSTREAM_VERSION;
+  header.size = sizeof(header);
+  header.rows = rows;
+  header.cols = cols;
+  header.channel_width = layout.channel_width;
+  header.num_pins = layout.num_pins;
+  header.frame_words = layout.words();
+  header.contexts = contexts;
+  // The file is sized up front, frames that are never written read as 0
+  // and so do their checksums
+  if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header) ||
+      ftruncate(fd, frameOffset(0, 0, contexts)) != 0) {
+    std::cerr << "Error: could not write bitstream " << path << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  DPRINTF("\n\tCreated %s: %d x %d x %d frames of %d words\n", path,
+          contexts, rows, cols, layout.words());
+}
+
+BitstreamFile::~BitstreamFile() {
+  if (frames)
+    munmap(reinterpret_cast<char *>(frames) - frameOffset(0, 0), map_size);
+  close(fd);
+}
+
+void BitstreamFile::mapFrames() {
+  if (frames)
+    return;
+  // The header is smaller than a page, so the whole file is mapped
+  map_size = frameOffset(0, 0, contexts);
+  void *map = mmap(NULL, map_size, PROT_READ | (writable ? PROT_WRITE : 0),
+                   MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    std::cerr << "Error: could not map bitstream " << path << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  frames = reinterpret_cast<uint64_t *>(static_cast<char *>(map) +
+                                        frameOffset(0, 0));
+  checksums = reinterpret_cast<uint64_t *>(static_cast<char *>(map) +
+                                           sizeof(BitstreamHeader));
+}
+
+off_t BitstreamFile::frameOffset(int x, int y, int context) const {
+  off_t frame = ((off_t)context * rows + y) * cols + x;
+  off_t table = (off_t)contexts * rows * cols * sizeof(uint64_t);
+  return sizeof(BitstreamHeader) + table +
+         frame * layout.words() * sizeof(uint64_t);
+}
+
+void BitstreamFile::checkBlock(int x, int y, int context) const {
+  if (x < 0 || x >= cols || y < 0 || y >= rows || context < 0 ||
+      context >= contexts) {
+    std::cerr << "Error: block (" << x << "," << y << ") of context "
+              << context << " is outside of " << path << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+void BitstreamFile::readFrame(int x, int y, uint64_t *words,
+                              int context) const {
+  checkBlock(x, y, context);
+  ssize_t size = layout.words() * sizeof(uint64_t);
+  if (pread(fd, words, size, frameOffset(x, y, context)) != size) {
+    std::cerr << "Error: could not read frame from " << path << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+void BitstreamFile::writeFrame(int x, int y, const uint64_t *words,
+                               int context) {
+  checkBlock(x, y, context);
+  ssize_t size = layout.words() * sizeof(uint64_t);
+  if (pwrite(fd, words, size, frameOffset(x, y, context)) != size) {
+    std::cerr << "Error: could not write frame to " << path << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+uint64_t FrameChecksum(const uint64_t *words, int count) {
+  uint64_t sum = 0;
+  bool zero = true;
+  for (int i = 0; i < count; i++) {
+    zero &= words[i] == 0;
+    // splitmix64 finalizer of the running sum and the word
+    uint64_t x = sum ^ words[i];
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    sum = x ^ (x >> 31);
+  }
+  if (zero)
+    return 0;
+  return sum ? sum : 1;
+}
+
+void MeasureInstruction(FrameLayout &measured, Instructions::Inst_t *inst) {
+  switch (inst->getOpcode()) {
+  case Instructions::_switch_: {
+    auto sw = static_cast<Instructions::Switch *>(inst);
+    measured.channel_width = MAX(measured.channel_width, sw->track() + 1);
+    break;
+  }
+  case Instructions::_connect_to_:
+  case Instructions::_connect_from_: {
+    auto cn = static_cast<Instructions::Connect *>(inst);
+    measured.channel_width = MAX(measured.channel_width, cn->track() + 1);
+    measured.num_pins = MAX(measured.num_pins, cn->pin() + 1);
+    break;
+  }
+  case Instructions::_bind_: {
+    auto bd = static_cast<Instructions::Bind *>(inst);
+    measured.num_pins = MAX(measured.num_pins, bd->pin() + 1);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+FrameLayout FitLayout(const Arch &arch, const FrameLayout &measured) {
+  FrameLayout layout(arch.getChannelWidth(), arch.getNumPins());
+  if (layout.channel_width == 0)
+    layout.channel_width = measured.channel_width;
+  if (layout.num_pins == 0)
+    layout.num_pins = measured.num_pins;
+  return layout;
+}
+
+FrameLayout MeasureLayout(Overlay &overlay) {
+  auto &arch = overlay.getArch();
+  FrameLayout layout(arch.getChannelWidth(), arch.getNumPins());
+  if (layout.channel_width > 0 && layout.num_pins > 0)
+    return layout;
+  // Every row is measured on its own, then the rows are reduced
+  int rows = overlay.getRows();
+  int cols = overlay.getCols();
+  std::vector<FrameLayout> row_layout(rows);
+  ParallelFor(rows, [&](int row) {
+    FrameLayout &measured = row_layout[row];
+    for (int i = row * cols; i < (row + 1) * cols; i++) {
+      auto &block = overlay.getBlock(i);
+      for (int context = 0; context < overlay.getContexts(); context++) {
+        block.for_each([&](Instructions::Inst_t *inst) {
+          MeasureInstruction(measured, inst);
+        }, context);
+      }
+    }
+  });
+  FrameLayout measured;
+  for (auto &row : row_layout) {
+    measured.channel_width = MAX(measured.channel_width, row.channel_width);
+    measured.num_pins = MAX(measured.num_pins, row.num_pins);
+  }
+  return FitLayout(arch, measured);
+}
+
+/** @brief Encoding kernel, instantiated for every supported layout. The
+ *  instructions are dispatched on their stored opcode, without virtual
+ *  calls.
+ */
+template <class Layout>
+static void EncodeKernel(Block &block, int context, const Layout &layout,
+                         uint64_t *words) {
+  FrameView<Layout> frame(layout, words);
+  const int width = layout.channel_width;
+  const int pins = layout.num_pins;
+  block.for_each([&](Instructions::Inst_t *inst) {
+    switch (inst->getOpcode()) {
+    case Instructions::_switch_: {
+      auto sw = static_cast<Instructions::Switch *>(inst);
+      CheckField("track", sw->track(), width);
+      frame.set(_sb_, sw->field(width), sw->value());
+      break;
+    }
+    case Instructions::_connect_to_:
+    case Instructions::_connect_from_: {
+      auto cn = static_cast<Instructions::Connect *>(inst);
+      CheckField("track", cn->track(), width);
+      CheckField("pin", cn->pin(), pins);
+      frame.set(cn->is_input() ? _cb_in_ : _cb_out_, cn->field(width, pins),
+                cn->value());
+      break;
+    }
+    case Instructions::_bind_: {
+      auto bd = static_cast<Instructions::Bind *>(inst);
+      CheckField("pin", bd->pin(), pins);
+      frame.set(_cu_, 2 * bd->pin(), bd->id() & 0xFFFF);
+      frame.set(_cu_, 2 * bd->pin() + 1, bd->id() >> 16);
+      break;
+    }
+    default:
+      break;
+    }
+  }, context);
+}
+
+// Channel widths and pin counts with a specialized kernel
+#define FIXED_LAYOUTS(X)                                                       \
+  X(4, 8) X(4, 16) X(8, 8) X(8, 16) X(16, 8) X(16, 16) X(32, 16) X(32, 32)
+
+template <int W, int P>
+static void EncodeFixed(Block &block, int context, const FrameLayout &,
+                        uint64_t *words) {
+  EncodeKernel(block, context, FixedLayout<W, P>(), words);
+}
+
+static void EncodeRuntime(Block &block, int context,
+                          const FrameLayout &layout, uint64_t *words) {
+  EncodeKernel(block, context, layout, words);
+}
+
+BlockEncoder SelectEncoder(const FrameLayout &layout) {
+#define FIXED_KERNEL(W, P)                                                     \
+  if (layout.channel_width == W && layout.num_pins == P)                       \
+    return EncodeFixed<W, P>;
+  FIXED_LAYOUTS(FIXED_KERNEL)
+#undef FIXED_KERNEL
+  return EncodeRuntime;
+}
+
+/** @brief encodes every distinct context configuration of block once,
+ *  into the zeroed frame_of(context) of the first context of its slot, and
+ *  copies it to the frames of the contexts sharing the slot. Then hands
+ *  the frame of each context to done.
+ */
+template <class F, class G>
+static void EncodeContexts(Block &block, BlockEncoder encode,
+                           const FrameLayout &layout, F frame_of, G done) {
+  int contexts = block.getContexts();
+  int words_per_frame = layout.words();
+  std::vector<uint64_t *> first(contexts, nullptr); // frame of every slot
+  for (int context = 0; context < contexts; context++) {
+    int slot = block.getSlot(context);
+    uint64_t *frame = frame_of(context);
+    if (!first[slot]) {
+      encode(block, context, layout, frame);
+      first[slot] = frame;
+    } else {
+      std::copy(first[slot], first[slot] + words_per_frame, frame);
+    }
+    done(context, frame);
+  }
+}
+
+// Blocks are encoded in square tiles, handed out to the threads one at a
+// time so dense and empty regions of the overlay balance out
+static const int TILE_SIZE = 16;
+
+/** @brief calls f(block index, scratch words) for every block of overlay
+ *  from several threads, tile by tile. Blocks of a tile are visited row by
+ *  row so their frames are written mostly sequentially.
+ */
+template <class F>
+static void ForEachBlock(Overlay &overlay, F f, int threads = 0) {
+  int rows = overlay.getRows();
+  int cols = overlay.getCols();
+  int tile_cols = (cols + TILE_SIZE - 1) / TILE_SIZE;
+  int tiles = ((rows + TILE_SIZE - 1) / TILE_SIZE) * tile_cols;
+  ParallelFor(tiles, [&](int tile) {
+    std::vector<uint64_t> words;
+    int x0 = (tile % tile_cols) * TILE_SIZE;
+    int y0 = (tile / tile_cols) * TILE_SIZE;
+    for (int y = y0; y < std::min(y0 + TILE_SIZE, rows); y++)
+      for (int x = x0; x < std::min(x0 + TILE_SIZE, cols); x++)
+        f(x + y * cols, words);
+  }, 1, threads);
+}
+
+int WriteBitstream(Overlay &overlay, const char *path,
+                   const FrameLayout *fixed, int threads) {
+  auto layout = fixed ? *fixed : MeasureLayout(overlay);
+  BitstreamFile image(path, overlay.getRows(), overlay.getCols(), layout,
+                      overlay.getContexts());
+  image.mapFrames();
+  int cols = overlay.getCols();
+  int words_per_frame = layout.words();
+  std::atomic<int> frames(0);
+  auto encode = SelectEncoder(layout);
+  // Frames are encoded in place, the scratch words are not needed
+  ForEachBlock(overlay, [&](int i, std::vector<uint64_t> &) {
+    // Empty blocks are already zero in the fresh image
+    auto &block = overlay.getBlock(i);
+    if (block.empty())
+      return;
+    int x = i % cols, y = i / cols;
+    EncodeContexts(block, encode, layout,
+                   [&](int context) { return image.frameData(x, y, context); },
+                   [&](int context, const uint64_t *frame) {
+                     image.frameChecksum(x, y, context) =
+                         FrameChecksum(frame, words_per_frame);
+                     frames++;
+                   });
+  }, threads);
+  DPRINTF("\n\tWrote %d frames to %s\n", frames.load(), path);
+  return frames;
+}
+
+int UpdateBitstream(Overlay &overlay, const char *path) {
+  BitstreamFile image(path, true);
+  auto &layout = image.getLayout();
+  if (image.getRows() != overlay.getRows() ||
+      image.getCols() != overlay.getCols() ||
+      image.getContexts() != overlay.getContexts()) {
+    std::cerr << "Error: " << path << " was built for a different overlay"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  image.mapFrames();
+  int cols = overlay.getCols();
+  int words_per_frame = layout.words();
+  std::atomic<int> frames(0);
+  auto encode = SelectEncoder(layout);
+  // Blocks left empty by the new routing encode to zero frames, which
+  // clears whatever configured them before
+  ForEachBlock(overlay, [&](int i, std::vector<uint64_t> &words) {
+    // Encoded into scratch frames first, to be compared with the image
+    int x = i % cols, y = i / cols;
+    words.assign(words_per_frame * overlay.getContexts(), 0);
+    EncodeContexts(overlay.getBlock(i), encode, layout,
+                   [&](int context) {
+                     return &words[context * words_per_frame];
+                   },
+                   [&](int context, const uint64_t *frame) {
+                     uint64_t checksum = FrameChecksum(frame, words_per_frame);
+                     uint64_t &stored = image.frameChecksum(x, y, context);
+                     // Only the checksum of an unchanged frame is read, the
+                     // frame itself is neither read nor written
+                     if (checksum != stored) {
+                       image.writeFrame(x, y, frame, context);
+                       stored = checksum;
+                       frames++;
+                     }
+                   });
+  });
+  DPRINTF("\n\tUpdated %d frames of %s\n", frames.load(), path);
+  return frames;
+}
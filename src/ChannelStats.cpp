@@ -0,0 +1,116 @@
+/** @file ChannelStats.cpp
+ *  @brief Channel utilization counters and their reports
+ *  @author Mahyar Emami (mayyxeng)
+ */
+#include "ChannelStats.h"
+#include "Config.h"
+#include <fstream>
+#include <iostream>
+
+ChannelStats::ChannelStats(int width)
+    : dim_x(0), dim_y(0), width(0), stride(MAX(width, 1)), dropped(0) {}
+
+void ChannelStats::resize(int rows, int cols) {
+  dim_x = cols + 2;
+  dim_y = rows + 2;
+  for (auto &chan : counts)
+    chan.assign((size_t)dim_x * dim_y * stride, 0);
+  dropped = 0;
+}
+
+void ChannelStats::widen(int new_width) {
+  width = new_width;
+  if (width <= stride)
+    return;
+  // Doubling keeps the copies rare when the width is not known up front
+  int new_stride = MAX(width, 2 * stride);
+  for (auto &chan : counts) {
+    std::vector<uint32_t> wide((size_t)dim_x * dim_y * new_stride, 0);
+    for (int i = 0; i < dim_x * dim_y; i++)
+      std::copy(chan.begin() + (size_t)i * stride,
+                chan.begin() + (size_t)(i + 1) * stride,
+                wide.begin() + (size_t)i * new_stride);
+    chan.swap(wide);
+  }
+  stride = new_stride;
+}
+
+void ChannelStats::merge(const ChannelStats &other) {
+  if (other.dim_x != dim_x || other.dim_y != dim_y) {
+    std::cerr << "Error: channel statistics of different arrays"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  if (other.width > width)
+    widen(other.width);
+  for (int chanx = 0; chanx < 2; chanx++)
+    for (int i = 0; i < dim_x * dim_y; i++)
+      for (int track = 0; track < other.width; track++)
+        counts[chanx][(size_t)i * stride + track] +=
+            other.counts[chanx][(size_t)i * other.stride + track];
+  dropped += other.dropped;
+}
+
+uint32_t ChannelStats::count(bool chanx, int x, int y, int track) const {
+  if (x < 0 || x >= dim_x || y < 0 || y >= dim_y || track < 0 ||
+      track >= width)
+    return 0;
+  return counts[chanx][(y * dim_x + x) * stride + track];
+}
+
+/** @brief opens a report file or exits */
+static void OpenReport(std::ofstream &out, const std::string &path) {
+  out.open(path);
+  if (!out) {
+    std::cerr << "Error: could not create " << path << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+void ChannelStats::writeHeatmap(const std::string &path) const {
+  std::ofstream out;
+  OpenReport(out, path);
+  out << "chan,x,y,track,count\n";
+  const char *names[] = {"CHANY", "CHANX"};
+  for (int chanx = 1; chanx >= 0; chanx--)
+    for (int y = 0; y < dim_y; y++)
+      for (int x = 0; x < dim_x; x++)
+        for (int track = 0; track < width; track++) {
+          uint32_t n = count(chanx, x, y, track);
+          if (n)
+            out << names[chanx] << ',' << x << ',' << y << ',' << track << ','
+                << n << '\n';
+        }
+  if (dropped)
+    DPRINTF("\n\t%llu track uses outside of the array were dropped\n",
+            (unsigned long long)dropped);
+}
+
+void ChannelStats::writeHistograms(const std::string &path) const {
+  // [row or column][chany, chanx]
+  std::vector<uint64_t> uses[2][2], tracks[2][2];
+  for (int chanx = 0; chanx < 2; chanx++) {
+    uses[0][chanx].assign(dim_y, 0);
+    tracks[0][chanx].assign(dim_y, 0);
+    uses[1][chanx].assign(dim_x, 0);
+    tracks[1][chanx].assign(dim_x, 0);
+    for (int y = 0; y < dim_y; y++)
+      for (int x = 0; x < dim_x; x++)
+        for (int track = 0; track < width; track++) {
+          uint32_t n = count(chanx, x, y, track);
+          uses[0][chanx][y] += n;
+          uses[1][chanx][x] += n;
+          tracks[0][chanx][y] += (n > 0);
+          tracks[1][chanx][x] += (n > 0);
+        }
+  }
+  std::ofstream out;
+  OpenReport(out, path);
+  out << "axis,index,chanx_uses,chany_uses,chanx_tracks,chany_tracks\n";
+  const char *axes[] = {"row", "col"};
+  for (int axis = 0; axis < 2; axis++)
+    for (size_t i = 0; i < uses[axis][0].size(); i++)
+      out << axes[axis] << ',' << i << ',' << uses[axis][1][i] << ','
+          << uses[axis][0][i] << ',' << tracks[axis][1][i] << ','
+          << tracks[axis][0][i] << '\n';
+}
@@ -6,9 +6,11 @@
 #include "Config.h"
 #include <iostream>
 #include <sstream>
+#include <string.h>
 Instructions::Switch::Switch(char in_alignment, int in_track,
                              Coordinate_t in_coord, char out_alignment,
-                             int out_track, Coordinate_t out_coord) {
+                             int out_track, Coordinate_t out_coord)
+    : Inst_t(_switch_) {
 
   coord = getSBPosition(in_coord, out_coord);
   Coordinate_t in_diff = in_coord - coord;
@@ -63,7 +65,6 @@ Instructions::Switch::Switch(char in_alignment, int in_track,
   op1.number = in_track;
   op2.number = out_track;
 }
-Coordinate_t Instructions::Switch::getCoordinates() { return coord; }
 Coordinate_t Instructions::Switch::getSBPosition(Coordinate_t pos1,
                                                  Coordinate_t pos2) {
   // SB position is (min(pos1.x, pos2.x), min(pos1.y, pos2.y))
@@ -99,23 +100,31 @@ std::string Instructions::Switch::LocToStr(TLoc loc) {
 }
 
 Instructions::Connect::Connect(char pin_dir, std::string pin_name, int pin_idx,
-                               Coordinate_t pin_pos, char aligment,
-                               int track_num, Coordinate_t track_pos) {
+                               int pin_num, Coordinate_t pin_pos,
+                               char aligment, int track_num,
+                               Coordinate_t track_pos) {
 
   connection_op.in_connection = (pin_dir != 'O') ? true : false;
   opcode = (pin_dir != 'O') ? _connect_to_ : _connect_from_;
   connection_op.number = pin_idx;
   connection_op.name = pin_name;
+  this->pin_num = pin_num;
   switch_op.number = track_num;
   connection_coord = pin_pos;
   switch_coord = track_pos;
-}
-
-Coordinate_t Instructions::Connect::getCoordinates() {
-  if (connection_op.in_connection)
-    return switch_coord;
-  else
-    return connection_coord;
+  coord = connection_op.in_connection ? switch_coord : connection_coord;
+  // Side of the ComputeUnit the track runs along. CHANX (x,y) is above CU
+  // (x,y) and CHANY (x,y) is on its right.
+  if (aligment == 'X') {
+    switch_op.loc =
+        (track_pos.at_y() == pin_pos.at_y()) ? Switch::_d0_ : Switch::_d1_;
+  } else if (aligment == 'Y') {
+    switch_op.loc =
+        (track_pos.at_x() == pin_pos.at_x()) ? Switch::_d3_ : Switch::_d2_;
+  } else {
+    DPRINTF("\n\tError: Invalid aligment %c\n", aligment);
+    exit(EXIT_FAILURE);
+  }
 }
 
 std::string Instructions::Connect::getStr() {
@@ -133,19 +142,34 @@ std::string Instructions::Connect::getStr() {
   }
 }
 
+/** @brief 32 bit FNV-1a hash used as component id, never 0 */
+static uint32_t ComponentId(const std::string &name) {
+  uint32_t hash = 2166136261u;
+  for (auto c : name) {
+    hash ^= (unsigned char)c;
+    hash *= 16777619u;
+  }
+  return hash ? hash : 1;
+}
+
 Instructions::Bind::Bind(std::string component_name, std::string pin_name,
-                         int pin_index, Coordinate_t coord, char dir) {
+                         int pin_index, int pin_num, Coordinate_t coord,
+                         char dir)
+    : Inst_t(_bind_) {
   component.name = component_name;
   component.index = 0;
-  pin.name = pin_name;
-  pin.index = pin_index;
+  component_id = ComponentId(component_name);
+  pin_op.name = pin_name;
+  pin_op.index = pin_index;
+  this->pin_num = pin_num;
   this->coord = coord;
   outbound = (dir == 'O') ? true : false;
 }
 
 std::string Instructions::Bind::getStr() {
   std::string inst("bind");
-  std::string pin_str = pin.name + "[" + std::to_string(pin.index) + "]";
+  std::string pin_str =
+      pin_op.name + "[" + std::to_string(pin_op.index) + "]";
   if (outbound)
     inst += " " + component.name + " " + pin_str + " #" + coord.tupleStr();
   else
@@ -197,3 +221,161 @@ void Config_t::print_instructions() {
     std::cout << (*iter)->getStr() << std::endl;
   }
 }
+
+/** @brief appends a 32 bit integer to a serialized instruction */
+static void PutInt(std::string &out, int32_t value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+/** @brief appends a length prefixed string to a serialized instruction */
+static void PutStr(std::string &out, const std::string &str) {
+  PutInt(out, str.size());
+  out.append(str);
+}
+
+static void PutCoord(std::string &out, const Coordinate_t &coord) {
+  PutInt(out, coord.at_x());
+  PutInt(out, coord.at_y());
+}
+
+void Instructions::Switch::serialize(std::string &out) const {
+  out.push_back(opcode);
+  PutCoord(out, coord);
+  PutInt(out, op1.loc);
+  PutInt(out, op1.number);
+  PutInt(out, op2.loc);
+  PutInt(out, op2.number);
+}
+
+void Instructions::Connect::serialize(std::string &out) const {
+  out.push_back(opcode);
+  PutCoord(out, connection_coord);
+  PutCoord(out, switch_coord);
+  PutInt(out, switch_op.loc);
+  PutInt(out, switch_op.number);
+  PutInt(out, connection_op.number);
+  PutInt(out, pin_num);
+  PutStr(out, connection_op.name);
+}
+
+void Instructions::Bind::serialize(std::string &out) const {
+  out.push_back(opcode);
+  PutCoord(out, coord);
+  PutInt(out, pin_op.index);
+  PutInt(out, pin_num);
+  out.push_back(outbound);
+  PutStr(out, pin_op.name);
+  PutStr(out, component.name);
+}
+
+/** @brief reads back the fields written by PutInt, PutStr and PutCoord.
+ *  Reading past the end clears ok.
+ */
+struct Reader {
+  Reader(const char *&in, const char *end) : in(in), end(end), ok(true){};
+  int32_t getInt() {
+    int32_t value = 0;
+    if (end - in < (long)sizeof(value)) {
+      ok = false;
+      return 0;
+    }
+    memcpy(&value, in, sizeof(value));
+    in += sizeof(value);
+    return value;
+  }
+  char getChar() {
+    if (in >= end) {
+      ok = false;
+      return 0;
+    }
+    return *in++;
+  }
+  std::string getStr() {
+    int32_t size = getInt();
+    if (size < 0 || end - in < size) {
+      ok = false;
+      return std::string("");
+    }
+    in += size;
+    return std::string(in - size, size);
+  }
+  Coordinate_t getCoord() {
+    int x = getInt();
+    return Coordinate_t(x, getInt());
+  }
+  /** @brief checks a location read back */
+  Instructions::Switch::TLoc getLoc() {
+    int32_t loc = getInt();
+    if (loc < Instructions::Switch::_d0_ || loc > Instructions::Switch::_d3_)
+      ok = false;
+    return (Instructions::Switch::TLoc)loc;
+  }
+
+  const char *&in;
+  const char *end;
+  bool ok;
+};
+
+std::unique_ptr<Instructions::Inst_t>
+Instructions::Inst_t::deserialize(const char *&in, const char *end) {
+  if (in >= end)
+    return nullptr;
+  switch (*in) {
+  case _switch_:
+    return Switch::deserialize(in, end);
+  case _connect_to_:
+  case _connect_from_:
+    return Connect::deserialize(in, end);
+  case _bind_:
+    return Bind::deserialize(in, end);
+  default:
+    return nullptr;
+  }
+}
+
+std::unique_ptr<Instructions::Inst_t>
+Instructions::Switch::deserialize(const char *&in, const char *end) {
+  Reader get(in, end);
+  std::unique_ptr<Switch> inst(new Switch());
+  get.getChar();
+  inst->coord = get.getCoord();
+  inst->op1.loc = get.getLoc();
+  inst->op1.number = get.getInt();
+  inst->op2.loc = get.getLoc();
+  inst->op2.number = get.getInt();
+  return get.ok ? std::move(inst) : nullptr;
+}
+
+std::unique_ptr<Instructions::Inst_t>
+Instructions::Connect::deserialize(const char *&in, const char *end) {
+  Reader get(in, end);
+  std::unique_ptr<Connect> inst(new Connect());
+  inst->opcode = (Opcode)get.getChar();
+  inst->connection_op.in_connection = (inst->opcode == _connect_to_);
+  inst->connection_coord = get.getCoord();
+  inst->switch_coord = get.getCoord();
+  inst->switch_op.loc = get.getLoc();
+  inst->switch_op.number = get.getInt();
+  inst->connection_op.number = get.getInt();
+  inst->pin_num = get.getInt();
+  inst->connection_op.name = get.getStr();
+  inst->coord = inst->connection_op.in_connection ? inst->switch_coord
+                                                  : inst->connection_coord;
+  return get.ok ? std::move(inst) : nullptr;
+}
+
+std::unique_ptr<Instructions::Inst_t>
+Instructions::Bind::deserialize(const char *&in, const char *end) {
+  Reader get(in, end);
+  std::unique_ptr<Bind> inst(new Bind());
+  get.getChar();
+  inst->coord = get.getCoord();
+  inst->pin_op.index = get.getInt();
+  inst->pin_num = get.getInt();
+  inst->outbound = get.getChar();
+  inst->pin_op.name = get.getStr();
+  inst->component.name = get.getStr();
+  inst->component.index = 0;
+  inst->component_id = ComponentId(inst->component.name);
+  return get.ok ? std::move(inst) : nullptr;
+}
@@ -4,48 +4,69 @@
  *
  */
 #include "Overlay.h"
+#include "Parallel.h"
+#include <algorithm>
 #include <iostream>
 
-Block::Block(Coordinate_t coordinates) {
+Block::Block(Coordinate_t coordinates, const Arch &arch, int contexts)
+    : context_slot(contexts), arch(&arch) {
   coord = coordinates;
-  CBIn = std::make_unique<ConnectionBox>(Coordinate_t(0, 1));
-  CBOut = std::make_unique<ConnectionBox>(Coordinate_t(1, 0));
-  SB = std::make_unique<SwitchBox>(Coordinate_t(0, 0));
-  CU = std::make_unique<ComputeUnit>(Coordinate_t(1, 1));
+  // Every context starts in its own slot until set_slots(), see freeze()
+  for (auto &unit : arch.getUnits()) {
+    switch (unit.kind) {
+    case _switch_box_:
+      units.push_back(std::make_unique<SwitchBox>(unit.local));
+      break;
+    case _connection_box_:
+      units.push_back(std::make_unique<ConnectionBox>(unit.local));
+      break;
+    case _compute_unit_:
+      units.push_back(std::make_unique<ComputeUnit>(unit.local));
+      break;
+    }
+    units.back()->resize(contexts);
+  }
+  for (int context = 0; context < contexts; context++)
+    context_slot[context] = context;
 }
 Coordinate_t Block::getCoordinates() { return coord; }
 
-Overlay::Overlay(int rows, int cols) : rows(rows), cols(cols) {
+Overlay::Overlay(int rows, int cols, const Arch &arch, int contexts,
+                 Coordinate_t origin)
+    : arch(arch), shards(rows), rows(rows), cols(cols), contexts(contexts),
+      origin(origin) {
 
-  DPRINTF("\n\tConstructing an overlay of size %d x %d\n", rows, cols);
+  DPRINTF("\n\tConstructing an overlay of size %d x %d, %d context(s)\n",
+          rows, cols, contexts);
   for (int i = 0; i < rows * cols; i++) {
-    Block new_block(Coordinate_t(i % cols, i / cols));
+    Block new_block(Coordinate_t(origin.at_x() + i % cols,
+                                 origin.at_y() + i / cols),
+                    this->arch, contexts);
     blocks.push_back(std::move(new_block));
   }
+  for (auto &shard : shards) {
+    shard.pending.resize(contexts);
+    shard.starts.push_back(0);
+  }
   for (int i = 0; i < rows * cols; i++) {
     DPRINTF("Inserted block @ %s\n",
             blocks[i].getCoordinates().tupleStr().c_str());
   }
 }
 
+int Overlay::blockIndex(const Instructions::Inst_t &inst) {
+  // The block of every opcode is a fixed offset given by the architecture
+  return arch.blockIndex(inst, origin, rows, cols);
+}
+
 void Overlay::push_back(std::unique_ptr<Instructions::Inst_t> inst) {
 
   auto inst_coord = inst->getCoordinates();
-  int block_index;
-  auto opcode = inst->getOpcode();
-
-  switch (opcode) {
-  case Instructions::_switch_:
-    block_index = inst_coord.at_x() + inst_coord.at_y() * cols;
-    break;
-  case Instructions::_connect_to_:
-    block_index = inst_coord.at_x() + (inst_coord.at_y() - 1) * cols;
-    break;
-  case Instructions::_connect_from_:
-    block_index = inst_coord.at_x() + 1 + inst_coord.at_y() * cols;
-    break;
-  default:
-    block_index = inst_coord.at_x() - 1 + (inst_coord.at_y() - 1) * cols;
+  int block_index = blockIndex(*inst);
+  if (block_index < 0) {
+    DPRINTF("\n\tError: instruction %s is outside of the overlay\n",
+            inst->getStr().c_str());
+    exit(EXIT_FAILURE);
   }
 
   DPRINTF("Found instruction @%s for block %d (%d, %d)\n",
@@ -54,45 +75,223 @@ void Overlay::push_back(std::unique_ptr<Instructions::Inst_t> inst) {
   blocks.at(block_index).push_back(std::move(inst));
 }
 
-void Block::push_back(std::unique_ptr<Instructions::Inst_t> inst) {
-
-  auto opcode = inst->getOpcode();
+/** @brief FNV-1a hash of a binary instruction form */
+static uint32_t HashForm(const char *data, size_t size) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; i++)
+    hash = (hash ^ (uint8_t)data[i]) * 16777619u;
+  return hash;
+}
 
-  switch (opcode) {
-  case Instructions::_switch_:
-    DPRINTF("Appending \'switch\' instruction:\n\t%s\n",
+void Overlay::push_back(std::unique_ptr<Instructions::Inst_t> inst,
+                        uint64_t seq, int context) {
+  int block_index = blockIndex(*inst);
+  if (block_index < 0) {
+    DPRINTF("\n\tError: instruction %s is outside of the overlay\n",
             inst->getStr().c_str());
-    SB->push_back(std::move(inst));
-    break;
-  case Instructions::_connect_to_:
-    DPRINTF("Appending \'connect(to)\' instruction :\n\t%s\n",
-            inst->getStr().c_str());
-    CBIn->push_back(std::move(inst));
-    break;
-  case Instructions::_connect_from_:
-    DPRINTF("Appending \'connect(from)'\ instruction:\n\t%s\n",
-            inst->getStr().c_str());
-    CBOut->push_back(std::move(inst));
-    break;
-  case Instructions::_bind_:
-    DPRINTF("Appending \'bind\' instructions:\n\t%s\n", inst->getStr().c_str());
-    CU->push_back(std::move(inst));
-  default:
-    break;
+    exit(EXIT_FAILURE);
   }
+  // Dropped by the architecture, as in Block::push_back
+  if (arch.getRule(inst->getOpcode()).slot < 0)
+    return;
+  std::string form;
+  inst->serialize(form);
+  inst.reset();
+  // Hashed before locking, the lock only covers the table lookup
+  uint32_t hash = HashForm(form.data(), form.size());
+  auto &shard = shards[block_index / cols];
+  std::lock_guard<std::mutex> guard(shard.lock);
+  uint32_t id = intern(shard, form, hash, block_index % cols);
+  shard.pending[context].push_back({seq, id});
+}
+
+uint32_t Overlay::intern(Shard &shard, const std::string &form,
+                         uint32_t hash, int col) {
+  uint32_t count = shard.block_col.size();
+  // Kept at most half full so the probes stay short
+  if (2 * (count + 1) > shard.table.size()) {
+    std::vector<int32_t> table(MAX(shard.table.size() * 2, 64), -1);
+    for (uint32_t id = 0; id < count; id++) {
+      uint32_t pos = shard.hashes[id];
+      while (table[pos & (table.size() - 1)] >= 0)
+        pos++;
+      table[pos & (table.size() - 1)] = id;
+    }
+    shard.table.swap(table);
+  }
+  uint32_t mask = shard.table.size() - 1;
+  for (uint32_t pos = hash;; pos++) {
+    int32_t id = shard.table[pos & mask];
+    if (id < 0) {
+      if (shard.forms.size() + form.size() > 0xFFFFFFFFu) {
+        std::cerr << "Error: too many distinct instructions in a row"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+      }
+      shard.table[pos & mask] = count;
+      shard.forms += form;
+      shard.starts.push_back(shard.forms.size());
+      shard.block_col.push_back(col);
+      shard.hashes.push_back(hash);
+      return count;
+    }
+    uint32_t start = shard.starts[id];
+    if (shard.starts[id + 1] - start == form.size() &&
+        shard.forms.compare(start, form.size(), form) == 0)
+      return id;
+  }
+}
+
+void Overlay::freeze() {
+  // Rows own disjoint blocks so they are drained in parallel
+  ParallelFor(rows, [&](int row) {
+    auto &shard = shards[row];
+    // Instructions of every block and context, in seq order
+    std::vector<std::vector<std::vector<uint32_t>>> configs(
+        cols, std::vector<std::vector<uint32_t>>(contexts));
+    for (int context = 0; context < contexts; context++) {
+      auto &pending = shard.pending[context];
+      std::sort(pending.begin(), pending.end(),
+                [](const Pending &a, const Pending &b) {
+                  return a.seq < b.seq;
+                });
+      for (auto &p : pending)
+        configs[shard.block_col[p.id]][context].push_back(p.id);
+      std::vector<Pending>().swap(pending);
+    }
+
+    // The first byte of a binary form is the opcode
+    auto unit_of = [&](uint32_t id) {
+      return arch
+          .getRule((Instructions::Opcode)shard.forms[shard.starts[id]])
+          .slot;
+    };
+    std::vector<int> slot_of(contexts);
+    for (int col = 0; col < cols; col++) {
+      auto &block_configs = configs[col];
+      // Contexts match if every unit gets the same instructions in the
+      // same order
+      for (auto &config : block_configs)
+        std::stable_sort(config.begin(), config.end(),
+                         [&](uint32_t a, uint32_t b) {
+                           return unit_of(a) < unit_of(b);
+                         });
+      int slots = 0;
+      for (int context = 0; context < contexts; context++) {
+        int first = 0;
+        while (block_configs[first] != block_configs[context])
+          first++;
+        slot_of[context] = (first == context) ? slots++ : slot_of[first];
+      }
+      auto &block = blocks[row * cols + col];
+      block.set_slots(slot_of, slots);
+      // Only the first context of every slot is built
+      for (int context = 0, built = 0; built < slots; context++) {
+        if (slot_of[context] != built)
+          continue;
+        for (auto id : block_configs[context]) {
+          const char *in = &shard.forms[shard.starts[id]];
+          block.append(unit_of(id),
+                       Instructions::Inst_t::deserialize(
+                           in, shard.forms.data() + shard.starts[id + 1]),
+                       context);
+        }
+        built++;
+      }
+    }
+    std::string().swap(shard.forms);
+    std::vector<uint32_t>().swap(shard.starts);
+    std::vector<uint32_t>().swap(shard.block_col);
+    std::vector<uint32_t>().swap(shard.hashes);
+    std::vector<int32_t>().swap(shard.table);
+  });
+}
+
+void Overlay::bulk_load(
+    std::vector<std::unique_ptr<Instructions::Inst_t>> insts, int context,
+    int threads) {
+  int count = insts.size();
+  int num_blocks = rows * cols;
+  std::vector<Placed> placed(count);
+  std::atomic<int> dropped(0);
+  ParallelFor(count, [&](int i) {
+    int block_index = blockIndex(*insts[i]);
+    if (block_index < 0) {
+      DPRINTF("\n\tError: instruction %s is outside of the overlay\n",
+              insts[i]->getStr().c_str());
+      exit(EXIT_FAILURE);
+    }
+    int slot = arch.getRule(insts[i]->getOpcode()).slot;
+    if (slot < 0) {
+      // Dropped by the architecture, sorted past the last block
+      block_index = num_blocks;
+      slot = 0;
+      dropped++;
+    }
+    placed[i] = {((uint64_t)block_index << 8) | slot, (uint32_t)i};
+  }, 4096, threads);
+
+  // Every unit holds a single opcode, see Arch::validate(), so the slot
+  // already orders the opcodes
+  int key_bits = 8;
+  while ((1ll << (key_bits - 8)) <= num_blocks)
+    key_bits++;
+  ParallelRadixSort(placed, [](const Placed &p) { return p.key; }, key_bits,
+                    threads);
+  DPRINTF("\n\tSorted %d instructions into %d blocks, %d dropped\n", count,
+          num_blocks, dropped.load());
+
+  ParallelFor(num_blocks, [&](int block_index) {
+    auto first = std::lower_bound(
+        placed.begin(), placed.end(), (uint64_t)block_index << 8,
+        [](const Placed &p, uint64_t key) { return p.key < key; });
+    auto &block = blocks[block_index];
+    for (auto iter = first;
+         iter != placed.end() && (int)(iter->key >> 8) == block_index; iter++)
+      block.append(iter->key & 0xFF, std::move(insts[iter->inst]), context);
+  }, 64, threads);
+}
+
+void Block::push_back(std::unique_ptr<Instructions::Inst_t> inst,
+                      int context) {
+
+  int slot = arch->getRule(inst->getOpcode()).slot;
+  if (slot < 0)
+    return;
+  DPRINTF("Appending instruction to %s:\n\t%s\n",
+          arch->getUnits()[slot].name.c_str(), inst->getStr().c_str());
+  units[slot]->push_back(std::move(inst), context_slot[context]);
+}
+
+bool Block::empty() const {
+  for (auto iter = units.begin(); iter != units.end(); iter++)
+    for (auto slot : context_slot)
+      if (!(*iter)->empty(slot))
+        return false;
+  return true;
+}
+
+void Block::set_slots(const std::vector<int> &slot_of, int slots) {
+  for (auto iter = units.begin(); iter != units.end(); iter++)
+    (*iter)->resize(slots);
+  context_slot = slot_of;
 }
 
 void Overlay::print_instructions() {
 
   for (auto iter = blocks.begin(); iter != blocks.end(); iter++) {
-    std::cout << "Printing instructions at block "
-              << (*iter).getCoordinates().tupleStr() << std::endl;
-    (*iter).print_instructions();
+    for (int context = 0; context < contexts; context++) {
+      std::cout << "Printing instructions at block "
+                << (*iter).getCoordinates().tupleStr();
+      if (contexts > 1)
+        std::cout << " context " << context << " (slot "
+                  << (*iter).getSlot(context) << ")";
+      std::cout << std::endl;
+      (*iter).print_instructions(context);
+    }
   }
 }
-void Block::print_instructions() {
-  SB->print_instructions();
-  CBIn->print_instructions();
-  CBOut->print_instructions();
-  CU->print_instructions();
+void Block::print_instructions(int context) {
+  for (auto iter = units.begin(); iter != units.end(); iter++)
+    (*iter)->print_instructions(context_slot[context]);
 }
@@ -5,154 +5,360 @@
  *  input and parsess the corresponding route and place files then
  *  returns the a configured Overlay class.
  *
+ *  Lines are first decoded into RouteNode and then RouteBuilder turns the
+ *  nodes into instructions, the binary front end ParseRecords shares the
+ *  second half.
+ *
  *  @author Mahyar Emami (mayyxeng)
  */
 #include "Parser.h"
+#include "RouteRecord.h"
+#include "RouteStream.h"
 #include <fstream>
 #include <iostream>
 #include <stdlib.h>
 #include <string>
+#include <thread>
 
-Overlay *ParseFiles(const char *circuit_name) {
-
-  auto route_file = std::string(circuit_name) + ".route";
-  auto place_file = std::string(circuit_name) + ".place";
-  std::fstream route(route_file);
-  if (!route.is_open()) {
-    std::cerr << "Error: could not open route file " << route_file << std::endl;
-    exit(EXIT_FAILURE);
-  }
+static const std::regex re_array(
+    "^Array size:\\s*(\\d*)\\s*x\\s*(\\d*)\\s*logic blocks.$");
+static const std::regex
+    re_net("^Net\\s*\\d*\\s*\\(\\w*\\.(\\w*)\\*(\\w*)\\*~\\w*\\.(\\w*)"
+           "\\*(\\w*)\\*\\)$");
+static const std::regex re_node_pad("^Node:\\s*(\\d*)\\s*(SOURCE|SINK)\\s*"
+                                    "\\((\\d*),(\\d*)\\)\\s*Class:\\s*(\\d*)");
+static const std::regex re_node_CHAN("^Node:\\s*(\\d*)\\s*CHAN(Y|X)\\s*"
+                                     "\\((\\d*),(\\d*)\\)\\s*Track: (\\d*) .*$");
+static const std::regex re_node_block(
+    "^Node:\\s*(\\d*)\\s*(O|I)PIN\\s*\\((\\d*),(\\d*)\\)\\s*Pin:\\s*(\\d*)\\s*("
+    "\\w*)\\.(\\w*)\\[(\\d*)\\]\\s*.*$");
 
-  Overlay *overlay = nullptr;
-  std::regex re_array(
-      "^Array size:\\s*(\\d*)\\s*x\\s*(\\d*)\\s*logic blocks.$");
-  std::regex re_net("^Net\\s*\\d*\\s*\\(\\w*\\.(\\w*)\\*(\\w*)\\*~\\w*\\.(\\w*)"
-                    "\\*(\\w*)\\*\\)$");
-  std::regex re_node_pad("^Node:\\s*(\\d*)\\s*(.*)$");
-  std::regex re_node_CHAN("^Node:\\s*(\\d*)\\s*CHAN(Y|X)\\s*"
-                          "\\((\\d*),(\\d*)\\)\\s*Track: (\\d*) .*$");
-  std::regex re_node_block_out(
-      "^Node:\\s*(\\d*)\\s*OPIN\\s*\\((\\d*),(\\d*)\\)\\s*Pin:\\s*(\\d*)\\s*("
-      "\\w*)\\.(\\w*)\\[(\\d*)\\]\\s*.*$");
-  std::regex re_node_block_in(
-      "^Node:\\s*(\\d*)\\s*IPIN\\s*\\((\\d*),(\\d*)\\)\\s*Pin:\\s*(\\d*)\\s*("
-      "\\w*)\\.(\\w*)\\[(\\d*)\\]\\s*.*$");
-  // std::regex re_node_CHANX("^Node:\\s*(\\d*)\\s*(CHANX)
-  // \\((\\d*),(\\d*)\\)\\s*Track: (\\d*) .*$");
-  /**
-
-
-  */
-  std::string line("");
-  std::string prev_line("");
+void DecodeRouteLine(const std::string &line, RouteNode &node) {
   std::smatch match;
-  std::string net_head("");
-  std::string net_tail("");
-  // /std::smatch prev_match;
-  parse_state_t state; // Present
-  parse_state_t prev_state = _init_;
-  while (!route.eof()) {
-    getline(route, line);
-
-    state = prev_state;
+  node.kind = _route_other_;
+  if (line.compare(0, 5, "Node:") != 0) {
     if (regex_search(line, match, re_array) && match.size() > 1) {
       DPRINTF("Found Array\n");
-      overlay =
-          new Overlay(atoi(match.str(1).c_str()), atoi(match.str(2).c_str()));
-    }
-    if (regex_search(line, match, re_net) && match.size() > 1) {
+      node.kind = _route_array_;
+      node.x = atoi(match.str(1).c_str());
+      node.y = atoi(match.str(2).c_str());
+    } else if (regex_search(line, match, re_net) && match.size() > 1) {
       DPRINTF("\n\tFound Net: \n\t%s\n", match.str(0).c_str());
-      state = _net_;
-      net_tail = match.str(2) + "." + match.str(1);
-      net_head = match.str(4) + "." + match.str(3);
-    } else if (regex_search(line, match, re_node_CHAN) && match.size() > 1) {
-      DPRINTF("\n\tFound CHAN%s: \n\t%s\n", match.str(2).c_str(),
-              match.str(0).c_str());
-      state = _chan_;
-      std::smatch prev_match;
-      if (prev_state == _chan_) {
-
-        regex_search(prev_line, prev_match, re_node_CHAN);
-
-        DPRINTF("\n\tPrev CHAN%s: \n\t%s\n", prev_match.str(2).c_str(),
-                prev_match.str(0).c_str());
-        Coordinate_t pos1(atoi(prev_match.str(3).c_str()),
-                          atoi(prev_match.str(4).c_str()));
-        Coordinate_t pos2(atoi(match.str(3).c_str()),
-                          atoi(match.str(4).c_str()));
-        Instructions::Switch new_switch_inst(
-            prev_match.str(2).c_str()[0], atoi(prev_match.str(5).c_str()), pos1,
-            match.str(2).c_str()[0], atoi(match.str(5).c_str()), pos2);
-        DPRINTF("%s\n", new_switch_inst.getStr().c_str());
-        overlay->push_back(
-            std::make_unique<Instructions::Switch>(new_switch_inst));
-
-      } else if (prev_state == _blk_out_) {
-        regex_search(prev_line, prev_match, re_node_block_out);
-        DPRINTF("\n\tPrev Port:\n\t(%s, %s) @ %s[%s]\n",
-                prev_match.str(2).c_str(), prev_match.str(3).c_str(),
-                prev_match.str(6).c_str(), prev_match.str(7).c_str());
-        Coordinate_t pin_pos(atoi(prev_match.str(2).c_str()),
-                             atoi(prev_match.str(3).c_str()));
-        Coordinate_t track_pos(atoi(match.str(3).c_str()),
-                               atoi(match.str(4).c_str()));
-        Instructions::Connect new_connect_inst(
-            'O', prev_match.str(6), atoi(prev_match.str(7).c_str()), pin_pos,
-            'X', atoi(match.str(5).c_str()), track_pos);
-        DPRINTF("%s\n", new_connect_inst.getStr().c_str());
-        overlay->push_back(
-            std::make_unique<Instructions::Connect>(new_connect_inst));
-      }
-    } else if (regex_search(line, match, re_node_block_out) &&
-               match.size() > 1) {
-      DPRINTF("\n\tFound CU OPin:\n\t%s\n", match.str(0).c_str());
-      state = _blk_out_;
-
-      // Bind net_tail to match.str(6)
-      Coordinate_t cu_pos(atoi(match.str(2).c_str()),
-                          atoi(match.str(3).c_str()));
-      Instructions::Bind new_bind_inst(net_tail, match.str(6),
-                                       atoi(match.str(7).c_str()), cu_pos, 'O');
-      DPRINTF("%s\n", new_bind_inst.getStr().c_str());
-      overlay->push_back(
-          std::make_unique<Instructions::Bind>(new_bind_inst));
-
-    } else if (regex_search(line, match, re_node_block_in) &&
-               match.size() > 1) {
-      DPRINTF("\n\tFound CU IPin:\n\t%s\n", match.str(0).c_str());
-      state = _blk_in_;
-      std::smatch prev_match;
-      if (prev_state == _chan_) {
-        regex_search(prev_line, prev_match, re_node_CHAN);
-        DPRINTF("\n\tPrev CHAN%s: \n\t%s\n", prev_match.str(2).c_str(),
-                prev_match.str(0).c_str());
-        Coordinate_t track_pos(atoi(prev_match.str(3).c_str()),
-                               atoi(prev_match.str(4).c_str()));
-        Coordinate_t pin_pos(atoi(match.str(2).c_str()),
-                             atoi(match.str(3).c_str()));
-        Instructions::Connect new_connect_inst(
-            'I', match.str(6), atoi(match.str(7).c_str()), pin_pos, 'Y',
-            atoi(prev_match.str(5).c_str()), track_pos);
-        DPRINTF("%s\n", new_connect_inst.getStr().c_str());
-        overlay->push_back(
-            std::make_unique<Instructions::Connect>(new_connect_inst));
-      }
+      node.kind = _route_net_;
+      node.port = match.str(2) + "." + match.str(1);
+      node.head = match.str(4) + "." + match.str(3);
+    }
+  } else if (regex_search(line, match, re_node_CHAN) && match.size() > 1) {
+    DPRINTF("\n\tFound CHAN%s: \n\t%s\n", match.str(2).c_str(),
+            match.str(0).c_str());
+    node.kind = (match.str(2) == "X") ? _route_chanx_ : _route_chany_;
+    node.id = atoi(match.str(1).c_str());
+    node.x = atoi(match.str(3).c_str());
+    node.y = atoi(match.str(4).c_str());
+    node.track_or_pin = atoi(match.str(5).c_str());
+  } else if (regex_search(line, match, re_node_block) && match.size() > 1) {
+    DPRINTF("\n\tFound CU %sPin:\n\t%s\n", match.str(2).c_str(),
+            match.str(0).c_str());
+    node.kind = (match.str(2) == "O") ? _route_opin_ : _route_ipin_;
+    node.id = atoi(match.str(1).c_str());
+    node.x = atoi(match.str(3).c_str());
+    node.y = atoi(match.str(4).c_str());
+    node.track_or_pin = atoi(match.str(5).c_str());
+    node.port = match.str(7);
+    node.port_index = atoi(match.str(8).c_str());
+  } else if (regex_search(line, match, re_node_pad) && match.size() > 1) {
+    node.kind = (match.str(2) == "SOURCE") ? _route_source_ : _route_sink_;
+    node.id = atoi(match.str(1).c_str());
+    node.x = atoi(match.str(3).c_str());
+    node.y = atoi(match.str(4).c_str());
+    node.track_or_pin = atoi(match.str(5).c_str());
+  }
+}
 
-      Coordinate_t cu_pos(atoi(match.str(2).c_str()),
-                          atoi(match.str(3).c_str()));
-      Instructions::Bind new_bind_inst(net_head, match.str(6),
-                                       atoi(match.str(7).c_str()), cu_pos, 'I');
-      DPRINTF("%s\n", new_bind_inst.getStr().c_str());
-      overlay->push_back(
-          std::make_unique<Instructions::Bind>(new_bind_inst));
+RouteBuilder::RouteBuilder(const Arch &arch, Emit emit)
+    : arch(arch), emit(emit), nets(nullptr), stats(nullptr),
+      prev_state(_init_) {
+  prev.kind = _route_other_;
+}
 
+void RouteBuilder::push(const RouteNode &node) {
+  // Lines that are not nets, channels or pins keep the state
+  parse_state_t state = prev_state;
+  switch (node.kind) {
+  case _route_net_:
+    state = _net_;
+    net_tail = node.port;
+    net_head = node.head;
+    if (nets)
+      nets->push_back({net_tail + " -> " + net_head, {-1, -1, -1}, {}});
+    break;
+  case _route_chanx_:
+  case _route_chany_: {
+    state = _chan_;
+    char axis = (node.kind == _route_chanx_) ? 'X' : 'Y';
+    // After a sink VPR lists the branch point of the next branch again,
+    // its track was already counted
+    if (stats && prev_state != _blk_in_)
+      stats->add(node.kind == _route_chanx_, node.x, node.y,
+                 node.track_or_pin);
+    if (prev_state == _chan_ &&
+        (prev.kind == _route_chanx_ || prev.kind == _route_chany_)) {
+      char prev_axis = (prev.kind == _route_chanx_) ? 'X' : 'Y';
+      DPRINTF("\n\tPrev CHAN%c: %d\n", prev_axis, prev.id);
+      Coordinate_t pos1(prev.x, prev.y);
+      Coordinate_t pos2(node.x, node.y);
+      auto new_switch_inst = std::make_unique<Instructions::Switch>(
+          prev_axis, prev.track_or_pin, pos1, axis, node.track_or_pin, pos2);
+      DPRINTF("%s\n", new_switch_inst->getStr().c_str());
+      emit(std::move(new_switch_inst));
 
+    } else if (prev_state == _blk_out_ && prev.kind == _route_opin_) {
+      DPRINTF("\n\tPrev Port:\n\t(%d, %d) @ %s[%d]\n", prev.x, prev.y,
+              prev.port.c_str(), prev.port_index);
+      Coordinate_t pin_pos(prev.x, prev.y);
+      Coordinate_t track_pos(node.x, node.y);
+      auto new_connect_inst = std::make_unique<Instructions::Connect>(
+          'O', prev.port, prev.port_index,
+          arch.pinNumber(prev.port, prev.port_index, prev.track_or_pin),
+          pin_pos, axis, node.track_or_pin, track_pos);
+      DPRINTF("%s\n", new_connect_inst->getStr().c_str());
+      emit(std::move(new_connect_inst));
+    }
+    break;
+  }
+  case _route_opin_: {
+    state = _blk_out_;
+    // Bind net_tail to the port
+    Coordinate_t cu_pos(node.x, node.y);
+    auto new_bind_inst = std::make_unique<Instructions::Bind>(
+        net_tail, node.port, node.port_index,
+        arch.pinNumber(node.port, node.port_index, node.track_or_pin), cu_pos,
+        'O');
+    DPRINTF("%s\n", new_bind_inst->getStr().c_str());
+    emit(std::move(new_bind_inst));
+    if (nets && !nets->empty())
+      nets->back().source = {node.x, node.y,
+                             arch.pinNumber(node.port, node.port_index,
+                                            node.track_or_pin)};
+    break;
+  }
+  case _route_ipin_: {
+    state = _blk_in_;
+    int pin_num = arch.pinNumber(node.port, node.port_index, node.track_or_pin);
+    if (prev_state == _chan_ &&
+        (prev.kind == _route_chanx_ || prev.kind == _route_chany_)) {
+      char prev_axis = (prev.kind == _route_chanx_) ? 'X' : 'Y';
+      DPRINTF("\n\tPrev CHAN%c: %d\n", prev_axis, prev.id);
+      Coordinate_t track_pos(prev.x, prev.y);
+      Coordinate_t pin_pos(node.x, node.y);
+      auto new_connect_inst = std::make_unique<Instructions::Connect>(
+          'I', node.port, node.port_index, pin_num, pin_pos, prev_axis,
+          prev.track_or_pin, track_pos);
+      DPRINTF("%s\n", new_connect_inst->getStr().c_str());
+      emit(std::move(new_connect_inst));
     }
-    prev_state = state;
 
-    prev_line = std::string(line);
+    Coordinate_t cu_pos(node.x, node.y);
+    auto new_bind_inst = std::make_unique<Instructions::Bind>(
+        net_head, node.port, node.port_index, pin_num, cu_pos, 'I');
+    DPRINTF("%s\n", new_bind_inst->getStr().c_str());
+    emit(std::move(new_bind_inst));
+    if (nets && !nets->empty())
+      nets->back().sinks.push_back({node.x, node.y, pin_num});
+    break;
+  }
+  default:
+    break;
+  }
+  prev_state = state;
+  prev = node;
+}
+
+/** @brief opens the route file of a circuit, plain or compressed */
+static std::unique_ptr<RouteStream> OpenRoute(const char *circuit_name) {
+  auto route_file = RouteStream::Locate(circuit_name);
+  if (route_file.empty()) {
+    std::cerr << "Error: could not open route file " << circuit_name
+              << ".route[.gz|.zst]" << std::endl;
+    exit(EXIT_FAILURE);
   }
+  return std::make_unique<RouteStream>(route_file);
+}
 
+/** @brief builds the instructions of a stream of nodes into an overlay
+ *  @param name name of the routing, for error messages
+ *  @param next fills the next node, returns 0 at the end of the routing
+ *  @param overlay shared overlay to fill, a new one is created if null and
+ *         loaded with Overlay::bulk_load
+ *  @param context configuration context of a shared overlay, the
+ *         instructions go through the thread-safe push_back
+ *  @param nets if given, filled with the terminals of the nets
+ *  @param stats if given, filled with the channel utilization
+ *  @return the configured overlay
+ */
+template <class Next>
+static Overlay *BuildOverlay(const char *name, Next next, const Arch &arch,
+                             Overlay *overlay, int context,
+                             std::vector<RouteNet> *nets,
+                             ChannelStats *stats) {
+  bool shared = (overlay != nullptr);
+  // Keys of the thread-safe push_back are unique across the contexts
+  uint64_t seq = (uint64_t)context << 40;
+  // A new overlay is built in bulk once the whole routing is decoded
+  std::vector<std::unique_ptr<Instructions::Inst_t>> insts;
+  RouteBuilder builder(arch, [&](std::unique_ptr<Instructions::Inst_t> inst) {
+    if (shared)
+      overlay->push_back(std::move(inst), seq++, context);
+    else
+      insts.push_back(std::move(inst));
+  });
+  builder.setNets(nets);
+  builder.setStats(stats);
+
+  RouteNode node;
+  while (next(node)) {
+    if (node.kind == _route_array_) {
+      int rows = node.x;
+      int cols = node.y;
+      if (stats)
+        stats->resize(rows, cols);
+      if (!overlay) {
+        overlay = new Overlay(rows, cols, arch);
+      } else if (rows != overlay->getRows() || cols != overlay->getCols()) {
+        std::cerr << "Error: " << name << " is routed on a " << rows << " x "
+                  << cols << " array, not " << overlay->getRows() << " x "
+                  << overlay->getCols() << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    } else if (overlay) {
+      builder.push(node);
+    }
+  }
+
+  if (!shared && overlay)
+    overlay->bulk_load(std::move(insts));
   DPRINTF("Parse complete\n");
   return overlay;
 }
+
+/** @brief parses the route file of a circuit into an overlay, see
+ *  BuildOverlay for the parameters
+ */
+static Overlay *ParseRoute(const char *circuit_name, const Arch &arch,
+                           Overlay *overlay, int context,
+                           std::vector<RouteNet> *nets, ChannelStats *stats) {
+
+  auto place_file = std::string(circuit_name) + ".place";
+  auto route_buf = OpenRoute(circuit_name);
+  std::istream route(route_buf.get());
+  std::string line("");
+  auto next = [&](RouteNode &node) {
+    if (!getline(route, line))
+      return false;
+    DecodeRouteLine(line, node);
+    return true;
+  };
+  return BuildOverlay(circuit_name, next, arch, overlay, context, nets,
+                      stats);
+}
+
+Overlay *ParseFiles(const char *circuit_name, const Arch &arch,
+                    std::vector<RouteNet> *nets, ChannelStats *stats) {
+  return ParseRoute(circuit_name, arch, nullptr, 0, nets, stats);
+}
+
+Overlay *ParseContexts(const std::vector<std::string> &circuits,
+                       const Arch &arch, ChannelStats *stats) {
+  // The array size is needed up front to share the overlay
+  int rows = 0, cols = 0;
+  {
+    auto route_buf = OpenRoute(circuits[0].c_str());
+    std::istream route(route_buf.get());
+    std::string line;
+    std::smatch match;
+    while (getline(route, line)) {
+      if (regex_search(line, match, re_array)) {
+        rows = atoi(match.str(1).c_str());
+        cols = atoi(match.str(2).c_str());
+        break;
+      }
+    }
+  }
+  if (rows == 0) {
+    std::cerr << "Error: no array size in " << circuits[0] << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  auto overlay = new Overlay(rows, cols, arch, circuits.size());
+  std::vector<std::thread> parsers;
+  // Every parser counts into its own statistics
+  std::vector<ChannelStats> thread_stats(circuits.size(),
+                                         ChannelStats(arch.getChannelWidth()));
+  for (size_t context = 0; context < circuits.size(); context++)
+    parsers.emplace_back([&, context]() {
+      ParseRoute(circuits[context].c_str(), arch, overlay, context, nullptr,
+                 stats ? &thread_stats[context] : nullptr);
+    });
+  for (auto &parser : parsers)
+    parser.join();
+  if (stats) {
+    stats->resize(rows, cols);
+    for (auto &counts : thread_stats)
+      stats->merge(counts);
+  }
+  overlay->freeze();
+  DPRINTF("Parsed %zu contexts\n", circuits.size());
+  return overlay;
+}
+
+Overlay *ParseRecords(const char *source, const Arch &arch,
+                      std::vector<RouteNet> *nets, ChannelStats *stats) {
+  RecordReader reader(source);
+  auto next = [&](RouteNode &node) { return reader.next(node); };
+  return BuildOverlay(source, next, arch, nullptr, 0, nets, stats);
+}
+
+/** @brief feeds a stream of nodes to a RouteBuilder, see
+ *  ParseInstructions
+ */
+template <class Next>
+static void StreamInstructions(const char *name, Next next, const Arch &arch,
+                               std::function<void(int, int)> on_array,
+                               RouteBuilder::Emit emit) {
+  RouteBuilder builder(arch, emit);
+  bool sized = false;
+  RouteNode node;
+  while (next(node)) {
+    if (node.kind == _route_array_) {
+      on_array(node.x, node.y);
+      sized = true;
+    } else if (sized) {
+      builder.push(node);
+    }
+  }
+  if (!sized) {
+    std::cerr << "Error: no array size in " << name << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+void ParseInstructions(const char *source, bool records, const Arch &arch,
+                       std::function<void(int, int)> on_array,
+                       RouteBuilder::Emit emit) {
+  if (records) {
+    RecordReader reader(source);
+    auto next = [&](RouteNode &node) { return reader.next(node); };
+    StreamInstructions(source, next, arch, on_array, emit);
+    return;
+  }
+  auto route_buf = OpenRoute(source);
+  std::istream route(route_buf.get());
+  std::string line("");
+  auto next = [&](RouteNode &node) {
+    if (!getline(route, line))
+      return false;
+    DecodeRouteLine(line, node);
+    return true;
+  };
+  StreamInstructions(source, next, arch, on_array, emit);
+}
@@ -0,0 +1,189 @@
+/** @file Partition.cpp
+ *  @brief Region grid, run files and region-partitioned emission
+ *  @author Mahyar Emami (mayyxeng)
+ */
+#include "Partition.h"
+#include "Bitstream.h"
+#include "Parallel.h"
+#include "Parser.h"
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <stdlib.h>
+#include <unistd.h>
+
+RegionGrid::RegionGrid(int rows, int cols, int grid_rows, int grid_cols)
+    : grid_rows(grid_rows), grid_cols(grid_cols) {
+  if (grid_rows < 1 || grid_cols < 1 || grid_rows > rows ||
+      grid_cols > cols) {
+    std::cerr << "Error: a " << rows << " x " << cols
+              << " array can not be split into " << grid_rows << " x "
+              << grid_cols << " regions" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  auto split = [](int size, int parts, std::vector<int> &start,
+                  std::vector<int> &part_of) {
+    part_of.resize(size);
+    for (int part = 0; part <= parts; part++)
+      start.push_back((long)size * part / parts);
+    for (int part = 0; part < parts; part++)
+      for (int i = start[part]; i < start[part + 1]; i++)
+        part_of[i] = part;
+  };
+  split(rows, grid_rows, row_start, row_region);
+  split(cols, grid_cols, col_start, col_region);
+}
+
+int RegionGrid::regionOf(Coordinate_t block) const {
+  int x = block.at_x();
+  int y = block.at_y();
+  if (x < 0 || x >= (int)col_region.size() || y < 0 ||
+      y >= (int)row_region.size())
+    return -1;
+  return row_region[y] * grid_cols + col_region[x];
+}
+
+Coordinate_t RegionGrid::origin(int region) const {
+  return Coordinate_t(col_start[region % grid_cols],
+                      row_start[region / grid_cols]);
+}
+
+int RegionGrid::getRows(int region) const {
+  int row = region / grid_cols;
+  return row_start[row + 1] - row_start[row];
+}
+
+int RegionGrid::getCols(int region) const {
+  int col = region % grid_cols;
+  return col_start[col + 1] - col_start[col];
+}
+
+RunFile::RunFile() : file(NULL), count(0) {
+  const char *dir = getenv("TMPDIR");
+  std::string path = std::string(dir && *dir ? dir : "/tmp") +
+                     "/bsmaker-run-XXXXXX";
+  int fd = mkstemp(&path[0]);
+  if (fd >= 0) {
+    // Nothing is left behind, even if the process dies
+    unlink(path.c_str());
+    file = fdopen(fd, "w+b");
+  }
+  if (file == NULL) {
+    std::cerr << "Error: could not create run file " << path << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+RunFile::~RunFile() { fclose(file); }
+
+void RunFile::append(const Instructions::Inst_t &inst) {
+  bytes.clear();
+  inst.serialize(bytes);
+  if (fwrite(bytes.data(), 1, bytes.size(), file) != bytes.size()) {
+    std::cerr << "Error: could not write run file" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  count++;
+}
+
+std::vector<std::unique_ptr<Instructions::Inst_t>> RunFile::load() {
+  long size = ftell(file);
+  std::string data(size, '\0');
+  rewind(file);
+  if (size < 0 || fread(&data[0], 1, size, file) != (size_t)size) {
+    std::cerr << "Error: could not read run file" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  // The binary forms are self-delimiting
+  std::vector<std::unique_ptr<Instructions::Inst_t>> insts;
+  insts.reserve(count);
+  const char *in = data.data();
+  const char *end = in + data.size();
+  while (in < end) {
+    auto inst = Instructions::Inst_t::deserialize(in, end);
+    if (!inst) {
+      std::cerr << "Error: corrupt run file" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    insts.push_back(std::move(inst));
+  }
+  rewind(file);
+  count = 0;
+  return insts;
+}
+
+int EmitRegions(const char *source, bool records, const Arch &arch,
+                int grid_rows, int grid_cols, const char *prefix, int jobs) {
+  std::unique_ptr<RegionGrid> grid;
+  std::vector<std::unique_ptr<RunFile>> runs;
+  int rows = 0, cols = 0;
+  FrameLayout measured;
+  ParseInstructions(
+      source, records, arch,
+      [&](int array_rows, int array_cols) {
+        if (grid) {
+          std::cerr << "Error: " << source << " has several arrays"
+                    << std::endl;
+          exit(EXIT_FAILURE);
+        }
+        rows = array_rows;
+        cols = array_cols;
+        grid.reset(new RegionGrid(rows, cols, grid_rows, grid_cols));
+        for (int region = 0; region < grid->regions(); region++)
+          runs.emplace_back(new RunFile());
+      },
+      [&](std::unique_ptr<Instructions::Inst_t> inst) {
+        // Dropped by the architecture, as in Overlay
+        if (arch.getRule(inst->getOpcode()).slot < 0)
+          return;
+        // Same check as Overlay::blockIndex, so the regions accept exactly
+        // the instructions of the whole overlay
+        int block_index = arch.blockIndex(*inst, Coordinate_t(), rows, cols);
+        if (block_index < 0) {
+          DPRINTF("\n\tError: instruction %s is outside of the overlay\n",
+                  inst->getStr().c_str());
+          exit(EXIT_FAILURE);
+        }
+        MeasureInstruction(measured, inst.get());
+        runs[grid->regionOf(Coordinate_t(block_index % cols,
+                                         block_index / cols))]
+            ->append(*inst);
+      });
+  auto layout = FitLayout(arch, measured);
+  DPRINTF("\n\tSpilled %d x %d array into %d regions\n", rows, cols,
+          grid->regions());
+
+  std::vector<std::string> images(grid->regions());
+  std::atomic<int> frames(0);
+  // Every worker holds a single region at a time and gets its share of
+  // the threads for the loops of the region
+  jobs = std::max(1, std::min(jobs, grid->regions()));
+  int threads = std::max(1, NumThreads() / jobs);
+  ParallelFor(grid->regions(), [&](int region) {
+    images[region] = std::string(prefix) + "." +
+                     std::to_string(region / grid_cols) + "." +
+                     std::to_string(region % grid_cols);
+    Overlay overlay(grid->getRows(region), grid->getCols(region), arch, 1,
+                    grid->origin(region));
+    overlay.bulk_load(runs[region]->load(), 0, threads);
+    frames += WriteBitstream(overlay, images[region].c_str(), &layout,
+                             threads);
+  }, 1, jobs);
+
+  auto list_path = std::string(prefix) + ".regions";
+  std::ofstream list(list_path);
+  if (!list) {
+    std::cerr << "Error: could not create " << list_path << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  list << "array " << rows << " " << cols << "\n";
+  for (int region = 0; region < grid->regions(); region++) {
+    auto origin = grid->origin(region);
+    list << images[region] << " " << origin.at_x() << " " << origin.at_y()
+         << " " << grid->getRows(region) << " " << grid->getCols(region)
+         << "\n";
+  }
+  DPRINTF("\n\tWrote %d regions, %d frames\n", grid->regions(),
+          frames.load());
+  return frames;
+}
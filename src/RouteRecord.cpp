@@ -0,0 +1,365 @@
+/** @file RouteRecord.cpp
+ *  @brief Binary route files and the shared-memory record ring
+ *  @author Mahyar Emami (mayyxeng)
+ */
+#include "RouteRecord.h"
+#include <chrono>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+static const char file_magic[8] = "BSMKRTE";
+static const char ring_magic[8] = "BSMKRNG";
+static const uint32_t record_version = 1;
+// Seconds a producer waits on a full ring for a consumer to attach
+static const int RING_ATTACH_TIMEOUT = 30;
+
+/** @return the shared memory object name of source, empty if it is a file */
+static std::string ShmName(const char *source) {
+  if (strncmp(source, "shm:", 4) != 0)
+    return std::string("");
+  return std::string("/") + (source + 4);
+}
+
+static size_t RingSize(uint32_t capacity) {
+  return sizeof(RecordRing) + (capacity - 1) * sizeof(RouteRecord);
+}
+
+RecordWriter::RecordWriter(const char *target, uint32_t capacity)
+    : file(NULL), ring(nullptr), ring_size(0) {
+  auto shm_name = ShmName(target);
+  if (shm_name.empty()) {
+    file = fopen(target, "wb");
+    if (file == NULL) {
+      std::cerr << "Error: could not create " << target << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    RecordFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, file_magic, sizeof(header.magic));
+    header.version = record_version;
+    header.record_size = sizeof(RouteRecord);
+    fwrite(&header, sizeof(header), 1, file);
+    buf.reserve(4096);
+    return;
+  }
+
+  if (capacity < 64 || (capacity & (capacity - 1)) != 0) {
+    std::cerr << "Error: ring capacity " << capacity
+              << " is not a power of 2 of at least 64" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  int fd = shm_open(shm_name.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0600);
+  ring_size = RingSize(capacity);
+  if (fd < 0 || ftruncate(fd, ring_size) != 0) {
+    std::cerr << "Error: could not create shared memory " << shm_name
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  void *map =
+      mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    std::cerr << "Error: could not map shared memory " << shm_name
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  ring = static_cast<RecordRing *>(map);
+  ring->record_size = sizeof(RouteRecord);
+  ring->capacity = capacity;
+  ring->producer = getpid();
+  ring->consumer.store(0);
+  ring->head.store(0);
+  ring->tail.store(0);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(ring->magic, ring_magic, sizeof(ring->magic));
+  // Publish in batches to keep the consumer off the head cache line
+  buf.reserve(capacity / 4);
+}
+
+RecordWriter::~RecordWriter() {
+  RouteRecord end;
+  memset(&end, 0, sizeof(end));
+  end.kind = _record_end_;
+  write(end);
+  flush();
+  if (file)
+    fclose(file);
+  if (ring)
+    munmap(ring, ring_size);
+}
+
+uint32_t RecordWriter::intern(const std::string &name) {
+  auto iter = names.find(name);
+  if (iter != names.end())
+    return iter->second;
+  uint32_t id = names.size();
+  names[name] = id;
+
+  RouteRecord record;
+  memset(&record, 0, sizeof(record));
+  record.kind = _record_name_;
+  record.name_id = id;
+  record.aux = name.size();
+  write(record);
+  for (size_t pos = 0; pos < name.size(); pos += sizeof(record)) {
+    memset(&record, 0, sizeof(record));
+    memcpy(&record, name.data() + pos,
+           std::min(sizeof(record), name.size() - pos));
+    write(record);
+  }
+  return id;
+}
+
+void RecordWriter::push(const RouteNode &node) {
+  RouteRecord record;
+  memset(&record, 0, sizeof(record));
+  switch (node.kind) {
+  case _route_net_:
+    record.name_id = intern(node.port);
+    record.aux = intern(node.head);
+    break;
+  case _route_opin_:
+  case _route_ipin_:
+    record.name_id = intern(node.port);
+    record.port_index = node.port_index;
+    break;
+  default:
+    break;
+  }
+  record.node_id = node.id;
+  record.kind = node.kind;
+  record.x = node.x;
+  record.y = node.y;
+  record.track_or_pin = node.track_or_pin;
+  write(record);
+}
+
+void RecordWriter::write(const RouteRecord &record) {
+  buf.push_back(record);
+  if (buf.size() == buf.capacity())
+    flush();
+}
+
+void RecordWriter::flush() {
+  if (file) {
+    fwrite(buf.data(), sizeof(RouteRecord), buf.size(), file);
+    buf.clear();
+    return;
+  }
+  uint64_t mask = ring->capacity - 1;
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  auto waiting = std::chrono::steady_clock::now();
+  for (size_t i = 0, spins = 0; i < buf.size();) {
+    // Wait for the consumer to free some slots
+    uint64_t space = ring->capacity -
+                     (head - ring->tail.load(std::memory_order_acquire));
+    if (space == 0) {
+      std::this_thread::yield();
+      if (++spins % 4096 == 0)
+        checkConsumer(waiting);
+      continue;
+    }
+    spins = 0;
+    waiting = std::chrono::steady_clock::now();
+    for (; space > 0 && i < buf.size(); space--, i++, head++)
+      ring->records[head & mask] = buf[i];
+    ring->head.store(head, std::memory_order_release);
+  }
+  buf.clear();
+}
+
+void RecordWriter::checkConsumer(
+    std::chrono::steady_clock::time_point waiting) {
+  uint32_t consumer = ring->consumer.load();
+  if (consumer == 0) {
+    if (std::chrono::steady_clock::now() - waiting >
+        std::chrono::seconds(RING_ATTACH_TIMEOUT)) {
+      std::cerr << "Error: no consumer attached to the ring within "
+                << RING_ATTACH_TIMEOUT << " seconds" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  } else if (kill(consumer, 0) != 0 && errno == ESRCH) {
+    std::cerr << "Error: consumer " << consumer
+              << " exited before the end of the routing" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+}
+
+RecordReader::RecordReader(const char *source)
+    : records(nullptr), count(0), pos(0), ring(nullptr), published(0),
+      map(nullptr), map_size(0) {
+  auto shm_name = ShmName(source);
+  if (shm_name.empty()) {
+    int fd = open(source, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+      std::cerr << "Error: could not open route records " << source
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    map_size = st.st_size;
+    if (map_size >= sizeof(RecordFileHeader))
+      map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == nullptr || map == MAP_FAILED) {
+      std::cerr << "Error: could not map route records " << source
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    madvise(map, map_size, MADV_SEQUENTIAL);
+    auto header = static_cast<const RecordFileHeader *>(map);
+    if (memcmp(header->magic, file_magic, sizeof(header->magic)) != 0 ||
+        header->version != record_version ||
+        header->record_size != sizeof(RouteRecord)) {
+      std::cerr << "Error: " << source << " is not a route record file"
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    records = reinterpret_cast<const RouteRecord *>(header + 1);
+    count = (map_size - sizeof(RecordFileHeader)) / sizeof(RouteRecord);
+    DPRINTF("\n\tMapped %zu route records of %s\n", count, source);
+    return;
+  }
+
+  // The producer may not have created the ring yet
+  int fd = -1;
+  for (int retry = 0; fd < 0 && retry < 3000; retry++) {
+    fd = shm_open(shm_name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+      usleep(10000);
+  }
+  struct stat st;
+  while (fd >= 0 && fstat(fd, &st) == 0 &&
+         (size_t)st.st_size < sizeof(RecordRing))
+    usleep(1000);
+  if (fd < 0) {
+    std::cerr << "Error: could not open shared memory " << shm_name
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  map_size = st.st_size;
+  map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    std::cerr << "Error: could not map shared memory " << shm_name
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  ring = static_cast<RecordRing *>(map);
+  while (memcmp(ring->magic, ring_magic, sizeof(ring_magic)) != 0) {
+    std::this_thread::yield();
+    std::atomic_thread_fence(std::memory_order_acquire);
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (ring->record_size != sizeof(RouteRecord) ||
+      RingSize(ring->capacity) > map_size) {
+    std::cerr << "Error: " << shm_name << " is not a route record ring"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  shm_unlink(shm_name.c_str());
+  ring->consumer.store(getpid());
+  pos = ring->tail.load();
+  count = pos;
+  published = pos;
+  DPRINTF("\n\tAttached to ring %s of %u records\n", shm_name.c_str(),
+          ring->capacity);
+}
+
+RecordReader::~RecordReader() {
+  if (map)
+    munmap(map, map_size);
+}
+
+const RouteRecord &RecordReader::read() {
+  if (!ring) {
+    if (pos == count) {
+      std::cerr << "Error: route records end without an end record"
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    return records[pos++];
+  }
+  // count caches the head of the producer
+  for (int spins = 1; pos == count; spins++) {
+    // The producer may be waiting for the slots consumed so far
+    if (published != pos) {
+      ring->tail.store(pos, std::memory_order_release);
+      published = pos;
+    }
+    count = ring->head.load(std::memory_order_acquire);
+    if (pos != count)
+      break;
+    std::this_thread::yield();
+    if (spins % 4096 == 0 && ring->producer != 0 &&
+        kill(ring->producer, 0) != 0 && errno == ESRCH) {
+      // The records it managed to publish have all been read
+      if (ring->head.load(std::memory_order_acquire) == pos) {
+        std::cerr << "Error: producer " << ring->producer
+                  << " exited before the end of the routing" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+  current = ring->records[pos & (ring->capacity - 1)];
+  // Slots are handed back in batches to keep off the head cache line
+  if (++pos - published >= ring->capacity / 4) {
+    ring->tail.store(pos, std::memory_order_release);
+    published = pos;
+  }
+  return current;
+}
+
+bool RecordReader::next(RouteNode &node) {
+  while (true) {
+    const RouteRecord &record = read();
+    if (record.kind == _record_end_)
+      return false;
+    if (record.kind == _record_name_) {
+      uint32_t id = record.name_id;
+      std::string name(record.aux, '\0');
+      for (size_t off = 0; off < name.size(); off += sizeof(RouteRecord)) {
+        const RouteRecord &bytes = read();
+        memcpy(&name[off], &bytes,
+               std::min(sizeof(RouteRecord), name.size() - off));
+      }
+      if (id >= names.size())
+        names.resize(id + 1);
+      names[id] = name;
+      continue;
+    }
+    if (record.kind > _route_other_) {
+      std::cerr << "Error: unknown route record kind " << (int)record.kind
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    node.kind = (route_kind_t)record.kind;
+    node.id = record.node_id;
+    node.x = record.x;
+    node.y = record.y;
+    node.track_or_pin = record.track_or_pin;
+    node.port_index = record.port_index;
+    switch (node.kind) {
+    case _route_net_:
+      node.port = names.at(record.name_id);
+      node.head = names.at(record.aux);
+      break;
+    case _route_opin_:
+    case _route_ipin_:
+      node.port = names.at(record.name_id);
+      break;
+    default:
+      break;
+    }
+    return true;
+  }
+}
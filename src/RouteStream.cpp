@@ -0,0 +1,244 @@
+/** @file RouteStream.cpp
+ *  @brief Decoder thread and ring buffer behind RouteStream
+ *  @author Mahyar Emami (mayyxeng)
+ */
+#include "RouteStream.h"
+#include "Config.h"
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+#ifdef BSMAKER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef BSMAKER_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/** @brief Plain *.route files, read with large unbuffered reads */
+class PlainSource : public RouteSource {
+public:
+  PlainSource(const std::string &path) {
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::cerr << "Error: could not open route file " << path << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+  ~PlainSource() { close(fd); }
+  size_t read(char *buf, size_t size) override {
+    ssize_t n = ::read(fd, buf, size);
+    if (n < 0) {
+      std::cerr << "Error: read failed on route file" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    return n;
+  }
+
+private:
+  int fd;
+};
+
+#ifdef BSMAKER_HAVE_ZLIB
+/** @brief gzip compressed *.route.gz files */
+class GzipSource : public RouteSource {
+public:
+  GzipSource(const std::string &path) {
+    file = gzopen(path.c_str(), "rb");
+    if (file == NULL) {
+      std::cerr << "Error: could not open route file " << path << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    gzbuffer(file, 1 << 20);
+  }
+  ~GzipSource() { gzclose(file); }
+  size_t read(char *buf, size_t size) override {
+    int n = gzread(file, buf, size);
+    int err = Z_OK;
+    const char *msg = (n <= 0) ? gzerror(file, &err) : "";
+    // A truncated stream ends with Z_BUF_ERROR instead of a clean end
+    if (n < 0 || (err != Z_OK && err != Z_STREAM_END)) {
+      std::cerr << "Error: corrupt or truncated route file: " << msg
+                << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    return n;
+  }
+
+private:
+  gzFile file;
+};
+#endif
+
+#ifdef BSMAKER_HAVE_ZSTD
+/** @brief zstd compressed *.route.zst files */
+class ZstdSource : public RouteSource {
+public:
+  ZstdSource(const std::string &path) : in_buf(ZSTD_DStreamInSize()) {
+    file = fopen(path.c_str(), "rb");
+    if (file == NULL) {
+      std::cerr << "Error: could not open route file " << path << std::endl;
+      exit(EXIT_FAILURE);
+    }
+    ctx = ZSTD_createDCtx();
+    input = {in_buf.data(), 0, 0};
+    pending = 0;
+  }
+  ~ZstdSource() {
+    ZSTD_freeDCtx(ctx);
+    fclose(file);
+  }
+  size_t read(char *buf, size_t size) override {
+    ZSTD_outBuffer output = {buf, size, 0};
+    while (output.pos == 0) {
+      if (input.pos == input.size) {
+        input.size = fread(in_buf.data(), 1, in_buf.size(), file);
+        input.pos = 0;
+        if (input.size == 0 && pending == 0)
+          return 0;
+      }
+      pending = ZSTD_decompressStream(ctx, &output, &input);
+      if (ZSTD_isError(pending)) {
+        DPRINTF("\n\tError: %s\n", ZSTD_getErrorName(pending));
+        exit(EXIT_FAILURE);
+      }
+      // Out of input while the decoder still expects some of the frame
+      if (input.size == 0 && output.pos == 0) {
+        std::cerr << "Error: truncated route file" << std::endl;
+        exit(EXIT_FAILURE);
+      }
+    }
+    return output.pos;
+  }
+
+private:
+  FILE *file;
+  ZSTD_DCtx *ctx;
+  std::vector<char> in_buf;
+  ZSTD_inBuffer input;
+  size_t pending; // last ZSTD_decompressStream result, 0 at a frame end
+};
+#endif
+
+static bool HasSuffix(const std::string &str, const std::string &suffix) {
+  return str.size() >= suffix.size() &&
+         str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+route_format_t RouteStream::FormatOf(const std::string &path) {
+  if (HasSuffix(path, ".gz"))
+    return _gzip_;
+  if (HasSuffix(path, ".zst"))
+    return _zstd_;
+  return _plain_;
+}
+
+std::string RouteStream::Locate(const char *circuit_name) {
+  const char *suffixes[] = {".route", ".route.gz", ".route.zst"};
+  for (auto suffix : suffixes) {
+    auto path = std::string(circuit_name) + suffix;
+    if (access(path.c_str(), R_OK) == 0)
+      return path;
+  }
+  return std::string("");
+}
+
+RouteStream::RouteStream(const std::string &path, size_t chunk_size,
+                         int chunks)
+    : ring(chunks, std::vector<char>(chunk_size)), filled(chunks, 0),
+      head(0), count(0), consuming(false), done(false), stop(false) {
+
+  switch (FormatOf(path)) {
+  case _gzip_:
+#ifdef BSMAKER_HAVE_ZLIB
+    source = std::make_unique<GzipSource>(path);
+    break;
+#else
+    std::cerr << "Error: BSMaker was built without gzip support" << std::endl;
+    exit(EXIT_FAILURE);
+#endif
+  case _zstd_:
+#ifdef BSMAKER_HAVE_ZSTD
+    source = std::make_unique<ZstdSource>(path);
+    break;
+#else
+    std::cerr << "Error: BSMaker was built without zstd support" << std::endl;
+    exit(EXIT_FAILURE);
+#endif
+  default:
+    source = std::make_unique<PlainSource>(path);
+  }
+  DPRINTF("\n\tStreaming %s through %d x %zu byte buffers\n", path.c_str(),
+          chunks, chunk_size);
+  setg(nullptr, nullptr, nullptr);
+  decoder = std::thread(&RouteStream::decode, this);
+}
+
+RouteStream::~RouteStream() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stop = true;
+  }
+  cond.notify_all();
+  decoder.join();
+}
+
+void RouteStream::decode() {
+  int chunks = ring.size();
+  while (true) {
+    int tail;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      cond.wait(guard, [&] { return count < chunks || stop; });
+      if (stop)
+        return;
+      tail = (head + count) % chunks;
+    }
+    // The tail buffer is owned by the decoder until it is published
+    auto &buf = ring[tail];
+    size_t size = 0;
+    bool eof = false;
+    while (size < buf.size()) {
+      size_t n = source->read(buf.data() + size, buf.size() - size);
+      if (n == 0) {
+        eof = true;
+        break;
+      }
+      size += n;
+    }
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (size > 0) {
+        filled[tail] = size;
+        count++;
+      }
+      done = eof;
+    }
+    cond.notify_all();
+    if (eof)
+      return;
+  }
+}
+
+RouteStream::int_type RouteStream::underflow() {
+  if (gptr() < egptr())
+    return traits_type::to_int_type(*gptr());
+
+  std::unique_lock<std::mutex> guard(lock);
+  if (consuming) {
+    // Hand the drained buffer back to the decoder
+    head = (head + 1) % ring.size();
+    count--;
+    consuming = false;
+    cond.notify_all();
+  }
+  cond.wait(guard, [&] { return count > 0 || done; });
+  if (count == 0) {
+    setg(nullptr, nullptr, nullptr);
+    return traits_type::eof();
+  }
+  consuming = true;
+  char *base = ring[head].data();
+  setg(base, base, base + filled[head]);
+  return traits_type::to_int_type(*gptr());
+}
@@ -10,11 +10,12 @@
 #include "Units.h" // for type Config_t
 
 void
-AbstractUnit::push_back(std::unique_ptr<Instructions::Inst_t> inst) {
-  config.push_back(std::move(inst));
+AbstractUnit::push_back(std::unique_ptr<Instructions::Inst_t> inst,
+                        int slot) {
+  configs[slot].push_back(std::move(inst));
 }
 
 void
-AbstractUnit::print_instructions() {
-  config.print_instructions();
+AbstractUnit::print_instructions(int slot) {
+  configs[slot].print_instructions();
 }
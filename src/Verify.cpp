@@ -0,0 +1,256 @@
+/** @file Verify.cpp
+ *  @brief Union-find connectivity check of configurations
+ *  @author Mahyar Emami (mayyxeng)
+ */
+#include "Verify.h"
+
+Connectivity::Connectivity(int rows, int cols, const FrameLayout &layout)
+    : dim_x(cols + 3), dim_y(rows + 3), width(layout.channel_width),
+      pins(layout.num_pins), invalid(0) {
+  long long all_nodes = (long long)dim_x * dim_y * (2 * width + pins);
+  if (all_nodes > 0x7FFFFFFF) {
+    std::cerr << "Error: " << all_nodes << " routing nodes are too many to "
+              << "verify" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  pin_base = 2 * dim_x * dim_y * width;
+  int nodes = all_nodes;
+  parent.resize(nodes);
+  rank.assign(nodes, 0);
+  for (int node = 0; node < nodes; node++)
+    parent[node] = node;
+  DPRINTF("\n\tVerifying %d routing nodes\n", nodes);
+}
+
+int Connectivity::find(int node) {
+  // Path halving keeps the trees flat without recursion
+  while (parent[node] != node) {
+    parent[node] = parent[parent[node]];
+    node = parent[node];
+  }
+  return node;
+}
+
+void Connectivity::unite(int a, int b) {
+  if (a < 0 || b < 0) {
+    invalid++;
+    return;
+  }
+  a = find(a);
+  b = find(b);
+  if (a == b)
+    return;
+  if (rank[a] < rank[b])
+    std::swap(a, b);
+  parent[b] = a;
+  if (rank[a] == rank[b])
+    rank[a]++;
+}
+
+int Connectivity::track(bool chanx, int x, int y, int track) {
+  x++;
+  y++;
+  if (x < 0 || x >= dim_x || y < 0 || y >= dim_y || track < 0 ||
+      track >= width)
+    return -1;
+  return ((chanx * dim_y + y) * dim_x + x) * width + track;
+}
+
+int Connectivity::pin(int x, int y, int pin) {
+  x++;
+  y++;
+  if (x < 0 || x >= dim_x || y < 0 || y >= dim_y || pin < 0 || pin >= pins)
+    return -1;
+  return pin_base + (y * dim_x + x) * pins + pin;
+}
+
+void Connectivity::connect(frame_section_t section, Coordinate_t pos,
+                           int field, uint16_t value) {
+  if (!(value & 0x8000))
+    return;
+  int x = pos.at_x();
+  int y = pos.at_y();
+  switch (section) {
+  case _sb_: {
+    // Channel of every side of the SwitchBox, see the file description
+    auto side = [&](int loc, int number) {
+      switch (loc) {
+      case Instructions::Switch::_d0_:
+        return track(false, x, y + 1, number);
+      case Instructions::Switch::_d1_:
+        return track(false, x, y, number);
+      case Instructions::Switch::_d2_:
+        return track(true, x, y, number);
+      default:
+        return track(true, x + 1, y, number);
+      }
+    };
+    unite(side((value >> 13) & 3, value & 0x1FFF),
+          side(field / width, field % width));
+    break;
+  }
+  case _cb_in_: {
+    // pos is the track, the side tells which ComputeUnit it feeds
+    int loc = (value >> 13) & 3;
+    int number = value & 0x1FFF;
+    int cu_pin = field % pins;
+    switch (loc) {
+    case Instructions::Switch::_d0_:
+      unite(track(true, x, y, number), pin(x, y, cu_pin));
+      break;
+    case Instructions::Switch::_d1_:
+      unite(track(true, x, y, number), pin(x, y + 1, cu_pin));
+      break;
+    case Instructions::Switch::_d2_:
+      unite(track(false, x, y, number), pin(x + 1, y, cu_pin));
+      break;
+    default:
+      unite(track(false, x, y, number), pin(x, y, cu_pin));
+    }
+    break;
+  }
+  case _cb_out_: {
+    // pos is the ComputeUnit
+    int loc = field / width;
+    int number = field % width;
+    int cu_pin = pin(x, y, value & 0x7FFF);
+    switch (loc) {
+    case Instructions::Switch::_d0_:
+      unite(track(true, x, y, number), cu_pin);
+      break;
+    case Instructions::Switch::_d1_:
+      unite(track(true, x, y - 1, number), cu_pin);
+      break;
+    case Instructions::Switch::_d2_:
+      unite(track(false, x - 1, y, number), cu_pin);
+      break;
+    default:
+      unite(track(false, x, y, number), cu_pin);
+    }
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+void Connectivity::addOverlay(Overlay &overlay, int context) {
+  for (int i = 0; i < overlay.getRows() * overlay.getCols(); i++) {
+    overlay.getBlock(i).for_each([&](Instructions::Inst_t *inst) {
+      switch (inst->getOpcode()) {
+      case Instructions::_switch_: {
+        auto sw = static_cast<Instructions::Switch *>(inst);
+        // Decoded as another track otherwise, as in the encoder
+        CheckField("track", sw->track(), width);
+        connect(_sb_, sw->getCoordinates(), sw->field(width), sw->value());
+        break;
+      }
+      case Instructions::_connect_to_:
+      case Instructions::_connect_from_: {
+        auto cn = static_cast<Instructions::Connect *>(inst);
+        CheckField("track", cn->track(), width);
+        CheckField("pin", cn->pin(), pins);
+        connect(cn->is_input() ? _cb_in_ : _cb_out_, cn->getCoordinates(),
+                cn->field(width, pins), cn->value());
+        break;
+      }
+      default:
+        break;
+      }
+    }, context);
+  }
+}
+
+void Connectivity::addBitstream(BitstreamFile &image, const Arch &arch,
+                                int context) {
+  image.mapFrames();
+  auto &layout = image.getLayout();
+  // Opcode whose instructions fill each section
+  const struct {
+    frame_section_t section;
+    Instructions::Opcode opcode;
+  } sections[] = {{_sb_, Instructions::_switch_},
+                  {_cb_in_, Instructions::_connect_to_},
+                  {_cb_out_, Instructions::_connect_from_}};
+  for (int y = 0; y < image.getRows(); y++)
+    for (int x = 0; x < image.getCols(); x++) {
+      uint64_t *words = image.frameData(x, y, context);
+      Frame frame(layout, words);
+      for (auto &sec : sections) {
+        auto &rule = arch.getRule(sec.opcode);
+        if (rule.slot < 0)
+          continue;
+        // Coordinates of the instructions stored in block (x, y)
+        Coordinate_t pos(x - rule.offset.at_x(), y - rule.offset.at_y());
+        const uint64_t *section = words + layout.offset(sec.section);
+        for (int field = 0; field < layout.fields(sec.section); field++) {
+          // Most words of a sparse frame are empty
+          if (field % 4 == 0 && section[field / 4] == 0) {
+            field += 3;
+            continue;
+          }
+          connect(sec.section, pos, field, frame.get(sec.section, field));
+        }
+      }
+    }
+}
+
+int Connectivity::check(const std::vector<RouteNet> &nets,
+                        std::ostream &out) {
+  int errors = 0;
+  if (invalid > 0) {
+    out << "Error: " << invalid
+        << " connections lead outside of the overlay" << std::endl;
+    errors += invalid;
+  }
+  // Net owning every set, by the root of its source
+  std::vector<int> owner(parent.size(), -1);
+  for (size_t i = 0; i < nets.size(); i++) {
+    auto &net = nets[i];
+    if (net.source.x < 0)
+      continue;
+    int source = pin(net.source.x, net.source.y, net.source.pin);
+    int root = (source < 0) ? -1 : find(source);
+    for (auto &sink : net.sinks) {
+      int node = pin(sink.x, sink.y, sink.pin);
+      if (root < 0 || node < 0 || find(node) != root) {
+        out << "Error: sink (" << sink.x << "," << sink.y << ") pin "
+            << sink.pin << " of net " << net.name
+            << " is not reachable from its source" << std::endl;
+        errors++;
+      }
+    }
+    if (root < 0)
+      continue;
+    if (owner[root] < 0) {
+      owner[root] = i;
+      continue;
+    }
+    // Nets listed twice for one driver are not a short
+    auto &other = nets[owner[root]];
+    if (other.source.x != net.source.x || other.source.y != net.source.y ||
+        other.source.pin != net.source.pin) {
+      out << "Error: nets " << other.name << " and " << net.name
+          << " are shorted" << std::endl;
+      errors++;
+    }
+  }
+  DPRINTF("\n\tVerified %zu nets, %d errors\n", nets.size(), errors);
+  return errors;
+}
+
+int VerifyOverlay(Overlay &overlay, const std::vector<RouteNet> &nets,
+                  int context) {
+  Connectivity conn(overlay.getRows(), overlay.getCols(),
+                    MeasureLayout(overlay));
+  conn.addOverlay(overlay, context);
+  return conn.check(nets, std::cerr);
+}
+
+int VerifyBitstream(const char *path, const Arch &arch,
+                    const std::vector<RouteNet> &nets, int context) {
+  BitstreamFile image(path, false);
+  Connectivity conn(image.getRows(), image.getCols(), image.getLayout());
+  conn.addBitstream(image, arch, context);
+  return conn.check(nets, std::cerr);
+}
@@ -2,26 +2,170 @@
 #include <fstream>
 #include <iostream>
 #include <vector>
+#include "Bitstream.h"
 #include "Overlay.h"
 #include "Parser.h"
+#include "Partition.h"
+#include "Verify.h"
 #include <memory>
+#include <unistd.h>
+
+static void usage(const char *prog) {
+  std::cerr << "Usage: " << prog << " [options] [circuit...]\n"
+            << "  -a arch   architecture config or VPR .xml file\n"
+            << "  -t tile   tile of the VPR architecture to use\n"
+            << "  -W width  channel width, overrides the architecture\n"
+            << "  -o image  write the bitstream image of circuit\n"
+            << "  -u image  update the changed blocks of an existing image\n"
+            << "  -i image  image to read blocks from without parsing\n"
+            << "  -b x,y    print the frame of block (x,y) of the image\n"
+            << "  -r source read binary route records from a file written\n"
+            << "            by route2bin or from the ring shm:name\n"
+            << "  -v        verify that the configuration connects every\n"
+            << "            net, the one of the image given with -i if any\n"
+            << "  -s prefix write the channel utilization to\n"
+            << "            prefix.heat.csv and prefix.hist.csv\n"
+            << "  -p RxC    split the overlay into R x C regions and write\n"
+            << "            the image of each to image.r.c with -o image\n"
+            << "  -j jobs   number of regions built at once with -p,\n"
+            << "            1 by default\n"
+            << "Several circuits are parsed as the contexts of one overlay.\n"
+            << "With no options the instructions of circuit are printed.\n";
+  exit(EXIT_FAILURE);
+}
+
+/** @brief prints the frame of block (x, y) stored in image */
+static void print_frame(const char *image, int x, int y) {
+  BitstreamFile file(image, false);
+  std::vector<uint64_t> words(file.getLayout().words());
+  file.readFrame(x, y, words.data());
+  std::cout << "Frame of block (" << x << "," << y << ") @ "
+            << file.frameOffset(x, y) << std::endl;
+  for (auto word : words) {
+    char hex[20];
+    snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)word);
+    std::cout << hex << std::endl;
+  }
+}
+
 int main(int argc, char **argv){
 
-  ConnectionBox cb();
-  ComputeUnit CU();
-  SwitchBox CB();
-  Block block();
-  Overlay ov();
-  std::vector <std::unique_ptr<int>> vec;
-  for (int i = 0; i < 10; i ++) {
-    vec.push_back(std::make_unique<int>(i));
+  const char *write_image = nullptr;
+  const char *update_image = nullptr;
+  const char *read_image = nullptr;
+  const char *arch_file = nullptr;
+  const char *records = nullptr;
+  const char *tile = "";
+  int width = 0;
+  const char *stats_prefix = nullptr;
+  bool verify = false;
+  int block_x = -1, block_y = -1;
+  int grid_rows = 0, grid_cols = 0;
+  int jobs = 1;
+  int opt;
+  while ((opt = getopt(argc, argv, "a:t:W:o:u:i:b:r:vs:p:j:")) != -1) {
+    switch (opt) {
+    case 'a':
+      arch_file = optarg;
+      break;
+    case 't':
+      tile = optarg;
+      break;
+    case 'W':
+      width = atoi(optarg);
+      break;
+    case 'o':
+      write_image = optarg;
+      break;
+    case 'u':
+      update_image = optarg;
+      break;
+    case 'i':
+      read_image = optarg;
+      break;
+    case 'b':
+      if (sscanf(optarg, "%d,%d", &block_x, &block_y) != 2)
+        usage(argv[0]);
+      break;
+    case 'r':
+      records = optarg;
+      break;
+    case 'v':
+      verify = true;
+      break;
+    case 's':
+      stats_prefix = optarg;
+      break;
+    case 'p':
+      if (sscanf(optarg, "%dx%d", &grid_rows, &grid_cols) != 2)
+        usage(argv[0]);
+      break;
+    case 'j':
+      jobs = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+    }
   }
-  for(int i = 0; i < 10; i++) {
-    std::cout << *vec[i] << " ";
+  std::vector<std::string> circuits(argv + optind, argv + argc);
+  if (circuits.empty())
+    circuits.push_back("../myblif");
+
+  if (read_image && !verify) {
+    if (block_x < 0)
+      usage(argv[0]);
+    print_frame(read_image, block_x, block_y);
+    return 0;
   }
-  std::cout << std::endl;
-  auto overlay = ParseFiles("../myblif");
-  overlay->print_instructions();
 
+  Arch arch = arch_file ? Arch::Load(arch_file, tile) : Arch();
+  if (width > 0)
+    arch.setChannelWidth(width);
+  // The nets of several contexts are not tracked
+  if (verify && !records && circuits.size() > 1)
+    usage(argv[0]);
+  // Regions are built straight from the routing of a single circuit
+  if (grid_rows > 0) {
+    if (!write_image || update_image || verify || stats_prefix ||
+        (!records && circuits.size() > 1))
+      usage(argv[0]);
+    EmitRegions(records ? records : circuits[0].c_str(), records != nullptr,
+                arch, grid_rows, grid_cols, write_image, jobs);
+    return 0;
+  }
+  std::vector<RouteNet> nets;
+  ChannelStats stats(arch.getChannelWidth());
+  auto *want_nets = verify ? &nets : nullptr;
+  auto *want_stats = stats_prefix ? &stats : nullptr;
+  Overlay *overlay;
+  if (records)
+    overlay = ParseRecords(records, arch, want_nets, want_stats);
+  else if (circuits.size() > 1)
+    overlay = ParseContexts(circuits, arch, want_stats);
+  else
+    overlay = ParseFiles(circuits[0].c_str(), arch, want_nets, want_stats);
+  if (stats_prefix) {
+    stats.writeHeatmap(std::string(stats_prefix) + ".heat.csv");
+    stats.writeHistograms(std::string(stats_prefix) + ".hist.csv");
+  }
+
+  if (read_image) {
+    int errors = VerifyBitstream(read_image, arch, nets);
+    if (block_x >= 0)
+      print_frame(read_image, block_x, block_y);
+    delete overlay;
+    return errors ? EXIT_FAILURE : 0;
+  }
+  int errors = verify ? VerifyOverlay(*overlay, nets) : 0;
+  if (write_image)
+    WriteBitstream(*overlay, write_image);
+  if (update_image)
+    UpdateBitstream(*overlay, update_image);
+  if (!write_image && !update_image && !verify)
+    overlay->print_instructions();
+  if (block_x >= 0 && (write_image || update_image))
+    print_frame(write_image ? write_image : update_image, block_x, block_y);
 
+  delete overlay;
+  return errors ? EXIT_FAILURE : 0;
 }
@@ -0,0 +1,58 @@
+/** @file route2bin.cpp
+ *  @brief Converts a *.route file into binary route records
+ *
+ *  Stands in for a router that emits records directly, to produce binary
+ *  route files or to feed the shared-memory ring of BSMaker -r shm:name.
+ *
+ *  @author Mahyar Emami (mayyxeng)
+ */
+#include "Parser.h"
+#include "RouteRecord.h"
+#include "RouteStream.h"
+#include <iostream>
+#include <stdlib.h>
+#include <unistd.h>
+
+static void usage(const char *prog) {
+  std::cerr << "Usage: " << prog << " [-c capacity] circuit target\n"
+            << "  circuit      circuit name, circuit.route[.gz|.zst] is read\n"
+            << "  target       binary route file, or shm:name for a ring\n"
+            << "  -c capacity  number of records of the ring\n";
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv) {
+  uint32_t capacity = 1 << 16;
+  int opt;
+  while ((opt = getopt(argc, argv, "c:")) != -1) {
+    switch (opt) {
+    case 'c':
+      capacity = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (argc - optind != 2)
+    usage(argv[0]);
+
+  auto route_file = RouteStream::Locate(argv[optind]);
+  if (route_file.empty()) {
+    std::cerr << "Error: could not open route file " << argv[optind]
+              << ".route[.gz|.zst]" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  RouteStream route_buf(route_file);
+  std::istream route(&route_buf);
+  RecordWriter writer(argv[optind + 1], capacity);
+  std::string line;
+  RouteNode node;
+  size_t nodes = 0;
+  while (getline(route, line)) {
+    DecodeRouteLine(line, node);
+    writer.push(node);
+    nodes++;
+  }
+  DPRINTF("Converted %zu lines\n", nodes);
+  return 0;
+}